@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <absl/strings/str_split.h>
+
+#include "physical_properties_database.h"
+#include "point.h"
+#include "port.h"
+#include "rectangle.h"
+#include "routing_grid.h"
+#include "routing_priority_queue.h"
+
+DEFINE_string(num_tracks, "50,100,200,400",
+              "Comma-separated list of grid sizes, in tracks per side");
+DEFINE_string(workloads, "random,clustered,fanout",
+              "Comma-separated list of net sets to route on each grid: "
+              "random, clustered or fanout");
+DEFINE_int32(num_nets, 50, "Number of nets in each net set");
+DEFINE_int32(num_clusters, 4,
+             "Number of clusters the ports of the clustered set gather in");
+DEFINE_int32(fanout, 16, "Number of sinks on each net of the fanout set");
+DEFINE_bool(compare_queues, false,
+            "Route each net set with every priority queue, with and without "
+            "A*, instead of only the binary heap with A*");
+DEFINE_int32(seed, 1, "Seed for the random net generator");
+
+// Measures how routing scales with grid size. For each size, a grid is built
+// by RoutingGrid::ConnectLayers and each set of synthetic nets is routed on a
+// fresh copy:
+//
+//    random:     two-pin nets between uniformly random points
+//    clustered:  two-pin nets between points gathered around a few centres,
+//                so that nets compete for the same tracks
+//    fanout:     nets of one driver and many sinks, routed as trees
+//
+// Each run prints one line of JSON, so that results can be collected and
+// compared across versions.
+
+namespace {
+
+static const int64_t kPitch = 100;
+static const int64_t kOffset = 50;
+
+void SetUpPhysicalDatabase(
+    int64_t side, boralago::PhysicalPropertiesDatabase *physical_db) {
+  boralago::RoutingLayerInfo layer_1;
+  layer_1.layer = 4;
+  layer_1.area = boralago::Rectangle(boralago::Point(0, 0), side, side);
+  layer_1.wire_width = 50;
+  layer_1.offset = kOffset;
+  layer_1.pitch = kPitch;
+  layer_1.direction = boralago::RoutingTrackDirection::kTrackVertical;
+
+  boralago::RoutingLayerInfo layer_2 = layer_1;
+  layer_2.layer = 5;
+  layer_2.direction = boralago::RoutingTrackDirection::kTrackHorizontal;
+
+  boralago::ViaInfo layer_1_2;
+  layer_1_2.layer = 6;
+  layer_1_2.cost = 1.0;
+  layer_1_2.width = 30;
+  layer_1_2.height = 30;
+  layer_1_2.overhang = 10;
+
+  physical_db->AddLayer(layer_1);
+  physical_db->AddLayer(layer_2);
+  physical_db->AddViaInfo(layer_1.layer, layer_2.layer, layer_1_2);
+}
+
+std::string QueueName(const boralago::RoutingQueueType &type) {
+  switch (type) {
+    case boralago::RoutingQueueType::kQueueBinaryHeap:
+      return "binary_heap";
+    case boralago::RoutingQueueType::kQueueRadixHeap:
+      return "radix_heap";
+    default:
+      return "unknown";
+  }
+}
+
+// The largest the process has been so far, in kilobytes. This never goes
+// down, so sizes should be run smallest first.
+long PeakMemoryKilobytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// The nets of a workload. Each net is a list of ports, the first of which is
+// the driver. Ports must outlive any grid they are routed on, since paths keep
+// pointers to them.
+struct Workload {
+  std::string name;
+  std::vector<std::unique_ptr<boralago::Port>> ports;
+  std::vector<std::vector<const boralago::Port*>> nets;
+};
+
+// Makes a port on the net about to be added to the workload, which is named
+// for the workload and its place in it.
+boralago::Port *MakePort(
+    const boralago::Point &centre, const boralago::Layer &layer,
+    Workload *workload) {
+  std::string net =
+      workload->name + "_" + std::to_string(workload->nets.size());
+  workload->ports.emplace_back(
+      new boralago::Port(centre, 50, 50, layer, net));
+  return workload->ports.back().get();
+}
+
+bool MakeWorkload(const std::string &name, int64_t side,
+                  std::mt19937 *generator, Workload *workload) {
+  workload->name = name;
+  std::uniform_int_distribution<int64_t> position(0, side - 1);
+  auto random_point = [&]() {
+    return boralago::Point(position(*generator), position(*generator));
+  };
+
+  if (name == "random") {
+    for (int i = 0; i < FLAGS_num_nets; ++i) {
+      workload->nets.push_back({MakePort(random_point(), 4, workload),
+                                MakePort(random_point(), 5, workload)});
+    }
+    return true;
+  }
+
+  if (name == "clustered") {
+    std::vector<boralago::Point> centres;
+    for (int i = 0; i < std::max(FLAGS_num_clusters, 1); ++i)
+      centres.push_back(random_point());
+    // Clusters are about a tenth of the grid across.
+    std::normal_distribution<double> spread(0.0, side / 20.0);
+    std::uniform_int_distribution<size_t> pick_centre(0, centres.size() - 1);
+    auto clustered_point = [&]() {
+      const boralago::Point &centre = centres[pick_centre(*generator)];
+      int64_t x = centre.x() + static_cast<int64_t>(spread(*generator));
+      int64_t y = centre.y() + static_cast<int64_t>(spread(*generator));
+      return boralago::Point(std::min(std::max(x, int64_t(0)), side - 1),
+                             std::min(std::max(y, int64_t(0)), side - 1));
+    };
+    for (int i = 0; i < FLAGS_num_nets; ++i) {
+      workload->nets.push_back({MakePort(clustered_point(), 4, workload),
+                                MakePort(clustered_point(), 5, workload)});
+    }
+    return true;
+  }
+
+  if (name == "fanout") {
+    for (int i = 0; i < FLAGS_num_nets; ++i) {
+      std::vector<const boralago::Port*> net = {
+          MakePort(random_point(), 4, workload)};
+      for (int j = 0; j < FLAGS_fanout; ++j)
+        net.push_back(MakePort(random_point(), 5, workload));
+      workload->nets.push_back(net);
+    }
+    return true;
+  }
+
+  LOG(ERROR) << "Unknown workload: " << name;
+  return false;
+}
+
+}   // namespace
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  std::vector<boralago::RoutingQueueType> queue_types = {
+      boralago::RoutingQueueType::kQueueBinaryHeap};
+  std::vector<bool> a_star_settings = {true};
+  if (FLAGS_compare_queues) {
+    queue_types.push_back(boralago::RoutingQueueType::kQueueRadixHeap);
+    a_star_settings = {false, true};
+  }
+
+  std::vector<std::string> sizes = absl::StrSplit(FLAGS_num_tracks, ',');
+  std::vector<std::string> workload_names =
+      absl::StrSplit(FLAGS_workloads, ',');
+  for (const std::string &size_str : sizes) {
+    int64_t num_tracks = std::stoll(size_str);
+    int64_t side = num_tracks * kPitch;
+
+    boralago::PhysicalPropertiesDatabase physical_db;
+    SetUpPhysicalDatabase(side, &physical_db);
+
+    for (const std::string &workload_name : workload_names) {
+      // Every configuration routes the same nets.
+      std::mt19937 generator(FLAGS_seed);
+      Workload workload;
+      if (!MakeWorkload(workload_name, side, &generator, &workload))
+        return EXIT_FAILURE;
+
+      for (bool use_a_star : a_star_settings) {
+        for (const boralago::RoutingQueueType &queue_type : queue_types) {
+          auto build_start = std::chrono::steady_clock::now();
+          boralago::RoutingGrid grid(physical_db);
+          grid.ConnectLayers(4, 5);
+          auto build_end = std::chrono::steady_clock::now();
+          size_t num_vertices = grid.vertices().size();
+
+          boralago::RoutingSearchOptions options;
+          options.queue_type = queue_type;
+          options.use_a_star = use_a_star;
+
+          size_t num_routed = 0;
+          size_t num_expanded = 0;
+          auto route_start = std::chrono::steady_clock::now();
+          for (const auto &net : workload.nets) {
+            boralago::RoutingSearchStats stats;
+            bool routed = net.size() == 2 ?
+                grid.AddRouteBetween(*net[0], *net[1], options, &stats) :
+                grid.AddMultiPointRoute(net, options, &stats);
+            if (routed)
+              ++num_routed;
+            num_expanded += stats.vertices_expanded;
+          }
+          auto route_end = std::chrono::steady_clock::now();
+
+          double build_ms = std::chrono::duration<double, std::milli>(
+              build_end - build_start).count();
+          double route_ms = std::chrono::duration<double, std::milli>(
+              route_end - route_start).count();
+          double success_rate = workload.nets.empty() ? 1.0 :
+              static_cast<double>(num_routed) / workload.nets.size();
+
+          std::ostringstream line;
+          line << "{\"tracks\": " << num_tracks
+               << ", \"workload\": \"" << workload.name << "\""
+               << ", \"queue\": \"" << QueueName(queue_type) << "\""
+               << ", \"a_star\": " << (use_a_star ? "true" : "false")
+               << ", \"vertices\": " << num_vertices
+               << ", \"nets\": " << workload.nets.size()
+               << ", \"routed\": " << num_routed
+               << ", \"success_rate\": " << success_rate
+               << ", \"vertices_expanded\": " << num_expanded
+               << ", \"build_ms\": " << build_ms
+               << ", \"route_ms\": " << route_ms
+               << ", \"peak_memory_kb\": " << PeakMemoryKilobytes() << "}";
+          std::cout << line.str() << std::endl;
+        }
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
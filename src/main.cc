@@ -23,6 +23,9 @@
 #include "routing_grid.h"
 
 DEFINE_string(example_flag, "default", "for later");
+DEFINE_string(routing_stats, "",
+              "If set, a JSON report of the work done routing, by phase and "
+              "by net, is written to this file");
 
 // TODO(aryap): Separate layout, circuit components into their own namespaces,
 // folders? They seem to solve very different problems and should be largely
@@ -121,6 +124,9 @@ int main(int argc, char **argv) {
   grid.AddRouteBetween(a, b);
   grid.AddRouteBetween(a, b);
 
+  if (!FLAGS_routing_stats.empty())
+    grid.WriteStatsReport(FLAGS_routing_stats);
+
   std::unique_ptr<boralago::PolyLineCell> grid_lines(
       grid.CreatePolyLineCell());
   boralago::Cell grid_cell = inflator.Inflate(*grid_lines);
@@ -53,7 +53,7 @@ void PhysicalPropertiesDatabase::AddViaInfo(
 }
 
 const ViaInfo &PhysicalPropertiesDatabase::GetViaInfo(
-    const Layer &lhs, const Layer &rhs) {
+    const Layer &lhs, const Layer &rhs) const {
   std::pair<const Layer&, const Layer&> ordered_layers =
       OrderFirstAndSecondLayers(lhs, rhs);
   const Layer &first = ordered_layers.first;
@@ -63,7 +63,7 @@ const ViaInfo &PhysicalPropertiesDatabase::GetViaInfo(
   LOG_IF(FATAL, first_it == via_infos_.end())
       << "No known connectiion between layer " << first
       << " and layer " << second;
-  std::map<Layer, ViaInfo> &inner_map = first_it->second;
+  const std::map<Layer, ViaInfo> &inner_map = first_it->second;
   auto second_it = inner_map.find(second);
   LOG_IF(FATAL, second_it == inner_map.end())
       << "No known connectiion between layer " << first
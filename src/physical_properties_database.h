@@ -63,10 +63,10 @@ class PhysicalPropertiesDatabase {
 
   void AddViaInfo(const Layer &lhs, const Layer &rhs, const ViaInfo &info);
 
-  const ViaInfo &GetViaInfo(const Via &via) {
+  const ViaInfo &GetViaInfo(const Via &via) const {
     return GetViaInfo(via.bottom_layer(), via.top_layer());
   }
-  const ViaInfo &GetViaInfo(const Layer &lhs, const Layer &rhs);
+  const ViaInfo &GetViaInfo(const Layer &lhs, const Layer &rhs) const;
 
  private:
   double internal_units_per_external_;
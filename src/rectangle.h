@@ -34,6 +34,12 @@ class Rectangle : public Shape {
   bool Overlaps(const Rectangle &other) const;
   const Rectangle OverlapWith(const Rectangle &other) const;
 
+  // Whether the point is inside or on the boundary.
+  bool Contains(const Point &point) const {
+    return point.x() >= lower_left_.x() && point.x() <= upper_right_.x() &&
+           point.y() >= lower_left_.y() && point.y() <= upper_right_.y();
+  }
+
   uint64_t Width() const { return upper_right_.x() - lower_left_.x(); }
   uint64_t Height() const { return upper_right_.y() - lower_left_.y(); }
 
@@ -0,0 +1,25 @@
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "routing_congestion.h"
+
+namespace boralago {
+
+void RoutingCongestion::Reset(std::size_t num_resources) {
+  occupancy_.assign(num_resources, 0);
+  history_.assign(num_resources, 0.0);
+}
+
+std::size_t RoutingCongestion::UpdateHistory(double history_increment) {
+  std::size_t num_overused = 0;
+  for (std::size_t i = 0; i < occupancy_.size(); ++i) {
+    if (!Overused(i))
+      continue;
+    history_[i] += history_increment * (occupancy_[i] - 1);
+    ++num_overused;
+  }
+  return num_overused;
+}
+
+}  // namespace boralago
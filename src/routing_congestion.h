@@ -0,0 +1,66 @@
+#ifndef ROUTING_CONGESTION_H_
+#define ROUTING_CONGESTION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace boralago {
+
+// Congestion state for negotiated routing.
+//
+// The resources are the tracks through each vertex, indexed like the states
+// of the shortest-path search: the resource for direction d through the
+// vertex with index i in the RoutingGraphView is 2 * i + d. Each can be used by
+// one net.
+//
+// While negotiating, nets are allowed to share resources but pay more to use
+// them: the cost of an edge is scaled by the present congestion of the
+// resources at either end (how many other nets use them now) and by their
+// history (how often they have been overused before). Since both factors are
+// at least 1, scaled costs never drop below the real ones and the A* lower
+// bound still holds.
+class RoutingCongestion {
+ public:
+  RoutingCongestion() : present_factor_(0) {}
+
+  // Forgets all use and history.
+  void Reset(std::size_t num_resources);
+
+  // The cost of an edge that uses the given resources at its ends.
+  double ScaledCost(std::size_t one_end, std::size_t other_end,
+                    double cost) const {
+    return cost * 0.5 * (Factor(one_end) + Factor(other_end));
+  }
+
+  void Occupy(std::size_t resource) { ++occupancy_[resource]; }
+  void Release(std::size_t resource) { --occupancy_[resource]; }
+
+  uint32_t occupancy(std::size_t resource) const {
+    return occupancy_[resource];
+  }
+  bool Overused(std::size_t resource) const { return occupancy_[resource] > 1; }
+
+  // Adds history_increment for every net too many on each overused resource.
+  // Returns the number of overused resources.
+  std::size_t UpdateHistory(double history_increment);
+
+  void set_present_factor(double present_factor) {
+    present_factor_ = present_factor;
+  }
+  double present_factor() const { return present_factor_; }
+
+ private:
+  double Factor(std::size_t resource) const {
+    return (1.0 + history_[resource]) *
+        (1.0 + present_factor_ * occupancy_[resource]);
+  }
+
+  double present_factor_;
+  std::vector<uint32_t> occupancy_;
+  std::vector<double> history_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_CONGESTION_H_
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_gcell_grid.h"
+#include "routing_priority_queue.h"
+
+namespace boralago {
+
+RoutingGCellGrid::RoutingGCellGrid(
+    const Rectangle &area, int64_t gcell_width, int64_t gcell_height)
+    : origin_(area.lower_left()),
+      gcell_width_(std::max(gcell_width, static_cast<int64_t>(1))),
+      gcell_height_(std::max(gcell_height, static_cast<int64_t>(1))) {
+  int64_t width = area.upper_right().x() - area.lower_left().x() + 1;
+  int64_t height = area.upper_right().y() - area.lower_left().y() + 1;
+  num_x_ = std::max((width + gcell_width_ - 1) / gcell_width_,
+                    static_cast<int64_t>(1));
+  num_y_ = std::max((height + gcell_height_ - 1) / gcell_height_,
+                    static_cast<int64_t>(1));
+}
+
+RoutingGCellGrid::LayerTracks *RoutingGCellGrid::FindOrCreateLayer(
+    const Layer &layer, const RoutingTrackDirection &direction) {
+  for (LayerTracks &tracks : layers_) {
+    if (tracks.layer == layer && tracks.direction == direction)
+      return &tracks;
+  }
+  LayerTracks tracks;
+  tracks.layer = layer;
+  tracks.direction = direction;
+  tracks.tracks.assign(
+      direction == RoutingTrackDirection::kTrackHorizontal ? num_y_ : num_x_,
+      0);
+  tracks.usage.assign(num_gcells(), 0);
+  layers_.push_back(tracks);
+  return &layers_.back();
+}
+
+void RoutingGCellGrid::AddTrack(
+    const Layer &layer,
+    const RoutingTrackDirection &direction,
+    int64_t offset) {
+  LayerTracks *tracks = FindOrCreateLayer(layer, direction);
+  bool horizontal = direction == RoutingTrackDirection::kTrackHorizontal;
+  int64_t position =
+      (offset - (horizontal ? origin_.y() : origin_.x())) /
+      (horizontal ? gcell_height_ : gcell_width_);
+  if (position < 0 || position >= static_cast<int64_t>(tracks->tracks.size()))
+    return;
+  ++tracks->tracks[position];
+}
+
+uint32_t RoutingGCellGrid::Capacity(
+    size_t gcell, const RoutingTrackDirection &direction) const {
+  size_t position = direction == RoutingTrackDirection::kTrackHorizontal ?
+      gcell / num_x_ : gcell % num_x_;
+  uint32_t capacity = 0;
+  for (const LayerTracks &tracks : layers_) {
+    if (tracks.direction == direction)
+      capacity += tracks.tracks[position];
+  }
+  return capacity;
+}
+
+uint32_t RoutingGCellGrid::Usage(
+    size_t gcell, const RoutingTrackDirection &direction) const {
+  uint32_t usage = 0;
+  for (const LayerTracks &tracks : layers_) {
+    if (tracks.direction == direction)
+      usage += tracks.usage[gcell];
+  }
+  return usage;
+}
+
+void RoutingGCellGrid::Use(
+    size_t gcell, const RoutingTrackDirection &direction) {
+  size_t position = direction == RoutingTrackDirection::kTrackHorizontal ?
+      gcell / num_x_ : gcell % num_x_;
+  LayerTracks *best = nullptr;
+  int64_t best_spare = std::numeric_limits<int64_t>::min();
+  for (LayerTracks &tracks : layers_) {
+    if (tracks.direction != direction)
+      continue;
+    int64_t spare = static_cast<int64_t>(tracks.tracks[position]) -
+        static_cast<int64_t>(tracks.usage[gcell]);
+    if (spare > best_spare) {
+      best = &tracks;
+      best_spare = spare;
+    }
+  }
+  LOG_IF(FATAL, best == nullptr)
+      << "No layer runs in direction " << direction;
+  ++best->usage[gcell];
+}
+
+bool RoutingGCellGrid::Route(
+    const Point &begin, const Point &end, double overflow_cost,
+    RoutingGCellRoute *route) {
+  route->gcells.clear();
+  if (!Covers(begin) || !Covers(end))
+    return false;
+
+  size_t source = GCellAt(begin);
+  size_t target = GCellAt(end);
+  int64_t target_i = target % num_x_;
+  int64_t target_j = target / num_x_;
+
+  // The GCell graph is small, so unlike the detailed search this just uses
+  // fresh arrays every time.
+  std::vector<double> cost(num_gcells(), std::numeric_limits<double>::max());
+  std::vector<size_t> previous(num_gcells(), num_gcells());
+  BinaryHeapQueue queue;
+  queue.Reset(num_gcells());
+
+  // Every step costs at least 1, so the number of GCells between here and
+  // the target is an admissible A* heuristic.
+  auto heuristic = [&](size_t gcell) {
+    int64_t i = gcell % num_x_;
+    int64_t j = gcell / num_x_;
+    return static_cast<double>(std::abs(i - target_i) + std::abs(j - target_j));
+  };
+  auto step_cost = [&](size_t boundary,
+                       const RoutingTrackDirection &direction) {
+    uint32_t capacity = Capacity(boundary, direction);
+    uint32_t usage = Usage(boundary, direction);
+    if (usage >= capacity)
+      return 2.0 + overflow_cost;
+    return 1.0 + static_cast<double>(usage) / capacity;
+  };
+
+  cost[source] = 0;
+  queue.Push(source, heuristic(source));
+  while (!queue.Empty()) {
+    size_t current = queue.Pop();
+    if (current == target)
+      break;
+    size_t i = current % num_x_;
+    size_t j = current / num_x_;
+
+    // Each neighbour, with the boundary (numbered by the GCell below or to
+    // the left of it) and direction of the step.
+    struct Step {
+      size_t gcell;
+      size_t boundary;
+      RoutingTrackDirection direction;
+    };
+    Step steps[4];
+    size_t num_steps = 0;
+    if (i + 1 < num_x_)
+      steps[num_steps++] = {current + 1, current, kTrackHorizontal};
+    if (i > 0)
+      steps[num_steps++] = {current - 1, current - 1, kTrackHorizontal};
+    if (j + 1 < num_y_)
+      steps[num_steps++] = {current + num_x_, current, kTrackVertical};
+    if (j > 0)
+      steps[num_steps++] = {
+          current - num_x_, current - num_x_, kTrackVertical};
+
+    for (size_t k = 0; k < num_steps; ++k) {
+      const Step &step = steps[k];
+      double next_cost =
+          cost[current] + step_cost(step.boundary, step.direction);
+      if (next_cost >= cost[step.gcell])
+        continue;
+      cost[step.gcell] = next_cost;
+      previous[step.gcell] = current;
+      double estimate = heuristic(step.gcell);
+      queue.Push(step.gcell, next_cost + estimate, estimate);
+    }
+  }
+
+  // The grid is connected, so the target is always found.
+  for (size_t gcell = target; gcell != source; gcell = previous[gcell])
+    route->gcells.push_back(gcell);
+  route->gcells.push_back(source);
+  std::reverse(route->gcells.begin(), route->gcells.end());
+
+  for (size_t k = 0; k + 1 < route->gcells.size(); ++k) {
+    size_t from = route->gcells[k];
+    size_t to = route->gcells[k + 1];
+    bool horizontal = from / num_x_ == to / num_x_;
+    Use(std::min(from, to), horizontal ? kTrackHorizontal : kTrackVertical);
+  }
+  return true;
+}
+
+size_t RoutingGCellGrid::NumOverflowed() const {
+  size_t num_overflowed = 0;
+  for (size_t gcell = 0; gcell < num_gcells(); ++gcell) {
+    if (gcell % num_x_ + 1 < num_x_ &&
+        Usage(gcell, kTrackHorizontal) > Capacity(gcell, kTrackHorizontal))
+      ++num_overflowed;
+    if (gcell / num_x_ + 1 < num_y_ &&
+        Usage(gcell, kTrackVertical) > Capacity(gcell, kTrackVertical))
+      ++num_overflowed;
+  }
+  return num_overflowed;
+}
+
+void RoutingCorridor::Add(const RoutingGCellRoute &route, size_t margin) {
+  int64_t num_x = grid_.num_x();
+  int64_t num_y = grid_.num_y();
+  int64_t reach = margin;
+  for (size_t gcell : route.gcells) {
+    int64_t i = gcell % num_x;
+    int64_t j = gcell / num_x;
+    for (int64_t y = std::max(j - reach, static_cast<int64_t>(0));
+         y <= std::min(j + reach, num_y - 1); ++y) {
+      for (int64_t x = std::max(i - reach, static_cast<int64_t>(0));
+           x <= std::min(i + reach, num_x - 1); ++x) {
+        included_[y * num_x + x] = 1;
+      }
+    }
+  }
+}
+
+}  // namespace boralago
@@ -0,0 +1,130 @@
+#ifndef ROUTING_GCELL_GRID_H_
+#define ROUTING_GCELL_GRID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "layer.h"
+#include "physical_properties_database.h"
+#include "point.h"
+#include "rectangle.h"
+
+namespace boralago {
+
+// A net's global route: the GCells it visits, in order. The detailed search is
+// held to a corridor around them and chooses its own layers and tracks.
+struct RoutingGCellRoute {
+  std::vector<size_t> gcells;
+};
+
+// A coarse grid of GCells (global routing cells) over the routing area, for
+// global routing. Nets are first routed from GCell to GCell, which is cheap,
+// and the detailed search for each net is then confined to the GCells near
+// its global route.
+//
+// The capacity of the boundary between two neighbouring GCells is estimated
+// from the tracks crossing it: a horizontal track crosses every boundary
+// between GCells side by side in its row, and a vertical track every one
+// between GCells stacked in its column. Blockages are not counted.
+class RoutingGCellGrid {
+ public:
+  // Covers the area with GCells of the given size. The last row and column
+  // may overhang it.
+  RoutingGCellGrid(const Rectangle &area,
+                   int64_t gcell_width,
+                   int64_t gcell_height);
+
+  // Counts a track on the given layer towards the capacity of the boundaries
+  // it crosses. The offset is its y coordinate if it is horizontal, or its x
+  // coordinate if vertical.
+  void AddTrack(const Layer &layer,
+                const RoutingTrackDirection &direction,
+                int64_t offset);
+
+  // Finds the cheapest route between the GCells containing the two points and
+  // takes a track on every boundary it crosses, on whichever layer running
+  // that way has the most left. Each step costs 1, plus the fraction of the
+  // boundary's capacity already used, plus overflow_cost if it is already
+  // full, so routes spread out before they overflow. Returns false if either
+  // point is outside the grid.
+  bool Route(const Point &begin, const Point &end, double overflow_cost,
+             RoutingGCellRoute *route);
+
+  bool Covers(const Point &point) const {
+    return point.x() >= origin_.x() && point.y() >= origin_.y() &&
+        point.x() < origin_.x() + static_cast<int64_t>(num_x_) * gcell_width_ &&
+        point.y() < origin_.y() + static_cast<int64_t>(num_y_) * gcell_height_;
+  }
+
+  // The GCell containing the point, which must be covered.
+  size_t GCellAt(const Point &point) const {
+    size_t i = (point.x() - origin_.x()) / gcell_width_;
+    size_t j = (point.y() - origin_.y()) / gcell_height_;
+    return j * num_x_ + i;
+  }
+
+  // The number of boundaries used by more nets than cross them.
+  size_t NumOverflowed() const;
+
+  size_t num_x() const { return num_x_; }
+  size_t num_y() const { return num_y_; }
+  size_t num_gcells() const { return num_x_ * num_y_; }
+
+ private:
+  // The tracks on one layer. Boundaries are numbered by the GCell below or to
+  // the left of them.
+  struct LayerTracks {
+    Layer layer;
+    RoutingTrackDirection direction;
+    // The number of tracks in each row (if horizontal) or column (if
+    // vertical).
+    std::vector<uint32_t> tracks;
+    // The number of nets using those tracks across each boundary.
+    std::vector<uint32_t> usage;
+  };
+
+  LayerTracks *FindOrCreateLayer(const Layer &layer,
+                                 const RoutingTrackDirection &direction);
+
+  // The total tracks and usage across the boundary leaving the GCell in the
+  // given direction, over all layers.
+  uint32_t Capacity(size_t gcell,
+                    const RoutingTrackDirection &direction) const;
+  uint32_t Usage(size_t gcell,
+                 const RoutingTrackDirection &direction) const;
+
+  // Takes a track across the boundary, on the layer with the most left.
+  void Use(size_t gcell, const RoutingTrackDirection &direction);
+
+  Point origin_;
+  int64_t gcell_width_;
+  int64_t gcell_height_;
+  size_t num_x_;
+  size_t num_y_;
+
+  std::vector<LayerTracks> layers_;
+};
+
+// The GCells in which a net's detailed search may go.
+class RoutingCorridor {
+ public:
+  explicit RoutingCorridor(const RoutingGCellGrid &grid)
+      : grid_(grid), included_(grid.num_gcells(), 0) {}
+
+  // Includes the GCells of the route, and those up to margin GCells away from
+  // them in either direction.
+  void Add(const RoutingGCellRoute &route, size_t margin);
+
+  bool Contains(const Point &point) const {
+    return grid_.Covers(point) && included_[grid_.GCellAt(point)];
+  }
+
+ private:
+  const RoutingGCellGrid &grid_;
+  std::vector<uint8_t> included_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_GCELL_GRID_H_
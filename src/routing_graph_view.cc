@@ -0,0 +1,132 @@
+#include <cstdint>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_graph_view.h"
+#include "routing_grid.h"
+
+namespace boralago {
+
+void RoutingGraphView::Rebuild(const std::vector<RoutingVertex*> &vertices) {
+  vertices_.clear();
+  centres_.clear();
+  vertex_costs_.clear();
+  live_.clear();
+  dirty_.clear();
+  begins_.clear();
+  ends_.clear();
+  targets_.clear();
+  edge_costs_.clear();
+  edge_layers_.clear();
+  edge_directions_.clear();
+  edges_.clear();
+  dirty_indices_.clear();
+
+  LOG_IF(FATAL, vertices.size() > kMaxIndex)
+      << "RoutingGraphView cannot index " << vertices.size() << " vertices";
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    RoutingVertex *vertex = vertices[i];
+    vertex->set_contextual_index(i);
+    vertices_.push_back(vertex);
+    centres_.push_back(vertex->centre());
+    vertex_costs_.push_back(vertex->cost());
+    live_.push_back(true);
+    dirty_.push_back(false);
+    begins_.push_back(0);
+    ends_.push_back(0);
+  }
+  for (size_t i = 0; i < vertices_.size(); ++i) {
+    AppendAdjacency(i);
+  }
+  num_live_vertices_ = vertices_.size();
+  num_abandoned_slots_ = 0;
+}
+
+void RoutingGraphView::AddVertex(RoutingVertex *vertex) {
+  size_t index = vertices_.size();
+  LOG_IF(FATAL, index >= kMaxIndex)
+      << "RoutingGraphView cannot index more than " << kMaxIndex
+      << " vertices";
+  vertex->set_contextual_index(index);
+  vertices_.push_back(vertex);
+  centres_.push_back(vertex->centre());
+  vertex_costs_.push_back(vertex->cost());
+  live_.push_back(true);
+  dirty_.push_back(false);
+  begins_.push_back(targets_.size());
+  ends_.push_back(targets_.size());
+  ++num_live_vertices_;
+  MarkDirty(vertex);
+}
+
+void RoutingGraphView::RemoveVertex(RoutingVertex *vertex) {
+  size_t index = vertex->contextual_index();
+  LOG_IF(FATAL, index >= vertices_.size() || vertices_[index] != vertex)
+      << "RoutingGraphView does not know vertex at " << vertex->centre();
+  if (!live_[index])
+    return;
+  live_[index] = false;
+  vertices_[index] = nullptr;
+  num_abandoned_slots_ += ends_[index] - begins_[index];
+  ends_[index] = begins_[index];
+  --num_live_vertices_;
+}
+
+void RoutingGraphView::MarkDirty(RoutingVertex *vertex) {
+  size_t index = vertex->contextual_index();
+  LOG_IF(FATAL, index >= vertices_.size() || vertices_[index] != vertex)
+      << "RoutingGraphView does not know vertex at " << vertex->centre();
+  if (dirty_[index])
+    return;
+  dirty_[index] = true;
+  dirty_indices_.push_back(index);
+}
+
+void RoutingGraphView::Flush() {
+  for (size_t index : dirty_indices_) {
+    dirty_[index] = false;
+    if (!live_[index])
+      continue;
+    num_abandoned_slots_ += ends_[index] - begins_[index];
+    AppendAdjacency(index);
+  }
+  dirty_indices_.clear();
+
+  // Compact once more than half of what we store is garbage.
+  if (num_abandoned_slots_ > targets_.size() / 2 ||
+      num_live_vertices_ < vertices_.size() / 2) {
+    std::vector<RoutingVertex*> live_vertices;
+    live_vertices.reserve(num_live_vertices_);
+    for (size_t i = 0; i < vertices_.size(); ++i) {
+      if (live_[i])
+        live_vertices.push_back(vertices_[i]);
+    }
+    Rebuild(live_vertices);
+  }
+}
+
+void RoutingGraphView::AppendAdjacency(size_t index) {
+  RoutingVertex *vertex = vertices_[index];
+  LOG_IF(FATAL, targets_.size() + vertex->edges().size() > kMaxIndex)
+      << "RoutingGraphView cannot hold more than " << kMaxIndex
+      << " edge slots";
+  begins_[index] = targets_.size();
+  for (RoutingEdge *edge : vertex->edges()) {
+    RoutingVertex *other =
+        edge->first() == vertex ? edge->second() : edge->first();
+    size_t other_index = other->contextual_index();
+    LOG_IF(FATAL, other_index >= vertices_.size() ||
+                  vertices_[other_index] != other)
+        << "Edge from " << vertex->centre() << " leads to vertex at "
+        << other->centre() << " unknown to RoutingGraphView";
+    targets_.push_back(other_index);
+    edge_costs_.push_back(edge->cost());
+    edge_layers_.push_back(edge->ExplicitOrTrackLayer());
+    edge_directions_.push_back(static_cast<uint8_t>(edge->Direction()));
+    edges_.push_back(edge);
+  }
+  ends_[index] = targets_.size();
+}
+
+}  // namespace boralago
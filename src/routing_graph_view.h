@@ -0,0 +1,107 @@
+#ifndef ROUTING_GRAPH_VIEW_H_
+#define ROUTING_GRAPH_VIEW_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "layer.h"
+#include "physical_properties_database.h"
+#include "point.h"
+
+namespace boralago {
+
+class RoutingEdge;
+class RoutingVertex;
+
+// A compact, read-mostly copy of the routing graph for the shortest-path
+// search to run on. Adjacency is stored in compressed sparse row form: the
+// edges leaving vertex i are the slots [Begin(i), End(i)) of a set of
+// contiguous arrays, so expanding a vertex touches a few cache lines instead of
+// chasing pointers through a std::set<RoutingEdge*>.
+//
+// Each vertex is given its contextual index by the view, and keeps it until the
+// next Rebuild().
+//
+// The view does not watch the graph. After changing the edges of a vertex the
+// owner must call MarkDirty() for it (or AddVertex()/RemoveVertex() for vertices
+// coming and going) and then Flush() before searching again. Flush() copies the
+// current adjacency of dirty vertices to the end of the slot arrays; the slots
+// they used before are abandoned until the next Rebuild().
+class RoutingGraphView {
+ public:
+  RoutingGraphView() : num_live_vertices_(0), num_abandoned_slots_(0) {}
+
+  // Discards everything and copies the adjacency of the given vertices,
+  // which are numbered in order.
+  void Rebuild(const std::vector<RoutingVertex*> &vertices);
+
+  // Gives the vertex the next index. Its edges are read at the next Flush().
+  void AddVertex(RoutingVertex *vertex);
+
+  // The vertex is never visited again. The vertex need not stay alive after
+  // this; its neighbours should be marked dirty.
+  void RemoveVertex(RoutingVertex *vertex);
+
+  void MarkDirty(RoutingVertex *vertex);
+
+  // Copies the adjacency of all dirty vertices. Rebuilds from scratch if too
+  // much of the view has been abandoned.
+  void Flush();
+
+  // The number of indices, including those of removed vertices.
+  size_t size() const { return vertices_.size(); }
+
+  bool live(size_t index) const { return live_[index]; }
+  RoutingVertex *vertex(size_t index) const { return vertices_[index]; }
+  const Point &centre(size_t index) const { return centres_[index]; }
+  double vertex_cost(size_t index) const { return vertex_costs_[index]; }
+
+  size_t Begin(size_t index) const { return begins_[index]; }
+  size_t End(size_t index) const { return ends_[index]; }
+
+  // The vertex at the other end of the edge in the given slot.
+  size_t target(size_t slot) const { return targets_[slot]; }
+  double edge_cost(size_t slot) const { return edge_costs_[slot]; }
+  const Layer &edge_layer(size_t slot) const { return edge_layers_[slot]; }
+  RoutingTrackDirection edge_direction(size_t slot) const {
+    return static_cast<RoutingTrackDirection>(edge_directions_[slot]);
+  }
+  RoutingEdge *edge(size_t slot) const { return edges_[slot]; }
+
+ private:
+  // Vertex indices and slots are stored in 32 bits to keep the arrays small,
+  // which limits how many of each there can be. Since abandoned slots are
+  // only reclaimed by compaction, the limit is on slots ever appended since
+  // the last Rebuild(), not on edges.
+  static constexpr size_t kMaxIndex = std::numeric_limits<uint32_t>::max();
+
+  // Copies the current edges of the vertex at index to the end of the slot
+  // arrays.
+  void AppendAdjacency(size_t index);
+
+  // Per-vertex arrays.
+  std::vector<RoutingVertex*> vertices_;
+  std::vector<Point> centres_;
+  std::vector<double> vertex_costs_;
+  std::vector<bool> live_;
+  std::vector<bool> dirty_;
+  std::vector<uint32_t> begins_;
+  std::vector<uint32_t> ends_;
+
+  // Per-slot arrays. Every edge appears once for each end.
+  std::vector<uint32_t> targets_;
+  std::vector<double> edge_costs_;
+  std::vector<Layer> edge_layers_;
+  std::vector<uint8_t> edge_directions_;
+  std::vector<RoutingEdge*> edges_;
+
+  std::vector<size_t> dirty_indices_;
+
+  size_t num_live_vertices_;
+  size_t num_abandoned_slots_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_GRAPH_VIEW_H_
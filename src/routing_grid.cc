@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <deque>
 #include <functional>
@@ -8,6 +10,8 @@
 #include <memory>
 #include <ostream>
 #include <queue>
+#include <string>
+#include <thread>
 #include <utility>
 #include <utility>
 #include <vector>
@@ -18,15 +22,45 @@
 #include "physical_properties_database.h"
 #include "poly_line.h"
 #include "routing_grid.h"
+#include "routing_priority_queue.h"
 #include "rectangle.h"
 
 namespace boralago {
 
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Adds the work done by a search, but not the cost of the path it found, to
+// a running total.
+void AddSearchCounters(const RoutingSearchStats &search,
+                       RoutingSearchStats *total) {
+  total->vertices_expanded += search.vertices_expanded;
+  total->queue_pushes += search.queue_pushes;
+  total->stale_pops += search.stale_pops;
+  total->window_rejections += search.window_rejections;
+  total->window_attempts += search.window_attempts;
+  total->window_margin = std::max(total->window_margin, search.window_margin);
+  total->seconds += search.seconds;
+}
+
+}   // namespace
+
 void RoutingEdge::set_track(RoutingTrack *track) {
   track_ = track;
   if (track_ != nullptr) set_layer(track_->layer());
 }
 
+RoutingTrackDirection RoutingEdge::Direction() const {
+  // Edges are always axis-aligned.
+  return first_->centre().y() == second_->centre().y() ?
+      RoutingTrackDirection::kTrackHorizontal :
+      RoutingTrackDirection::kTrackVertical;
+}
+
 const Layer &RoutingEdge::ExplicitOrTrackLayer() const {
   if (track_ != nullptr)
     return track_->layer();
@@ -34,13 +68,24 @@ const Layer &RoutingEdge::ExplicitOrTrackLayer() const {
 }
 
 
+void RoutingVertex::AddEdge(RoutingEdge *edge) {
+  if (std::find(edges_.begin(), edges_.end(), edge) == edges_.end())
+    edges_.push_back(edge);
+}
+
 bool RoutingVertex::RemoveEdge(RoutingEdge *edge) {
-  return edges_.erase(edge) > 0;
+  auto it = std::find(edges_.begin(), edges_.end(), edge);
+  if (it == edges_.end())
+    return false;
+  edges_.erase(it);
+  return true;
 }
 
 RoutingPath::RoutingPath(
     RoutingVertex *start, const std::deque<RoutingEdge*> edges)
-    : edges_(edges.begin(), edges.end()) {
+    : start_port_(nullptr),
+      end_port_(nullptr),
+      edges_(edges.begin(), edges.end()) {
   vertices_.push_back(start);
   RoutingVertex *last = start;
   for (RoutingEdge *edge : edges) {
@@ -85,6 +130,10 @@ void RoutingPath::ToPolyLinesAndVias(
       last->set_start_via(via);
       continue;
     }
+    // Straight runs are chains of edges between neighbouring vertices; only
+    // the corners need to be in the line.
+    if (edges_.at(i - 1)->Direction() == edge->Direction())
+      continue;
     last->AddSegment(current->centre());
   }
   last->AddSegment(vertices_.back()->centre());
@@ -108,20 +157,20 @@ std::ostream &operator<<(std::ostream &os, const RoutingPath &path) {
   return os;
 }
 
-bool RoutingTrackBlockage::Contains(int64_t position) {
+bool RoutingTrackBlockage::Contains(int64_t position) const {
   return position >= start_ && position <= end_;
 }
 
-bool RoutingTrackBlockage::IsAfter(int64_t position) {
+bool RoutingTrackBlockage::IsAfter(int64_t position) const {
   return position <= start_;
 }
 
-bool RoutingTrackBlockage::IsBefore(int64_t position) {
+bool RoutingTrackBlockage::IsBefore(int64_t position) const {
   return position >= end_;
 }
 
 // Whether the given span [low, high] overlaps with this blockage.
-bool RoutingTrackBlockage::Blocks(int64_t low, int64_t high) {
+bool RoutingTrackBlockage::Blocks(int64_t low, int64_t high) const {
   return Contains(low) || Contains(high) || (low <= start_ && high >= end_);
 }
 
@@ -132,17 +181,20 @@ bool RoutingTrack::RemoveEdge(RoutingEdge *edge, bool and_delete) {
   // Remove the edge from the vertices on which it lands.
   edge->first()->RemoveEdge(edge);
   edge->second()->RemoveEdge(edge);
-  edge->set_track(nullptr);
   if (and_delete)
-    delete edge;
+    edge_pool_->Delete(edge);
   return true;
 }
 
 bool RoutingTrack::MaybeAddEdgeBetween(
     RoutingVertex *one, RoutingVertex *the_other) {
+  // A zero-length edge would need an empty RoutingTrackBlockage once used.
+  if (ProjectOntoTrack(one->centre()) == ProjectOntoTrack(the_other->centre()))
+    return false;
   if (IsBlockedBetween(one->centre(), the_other->centre()))
     return false;
-  RoutingEdge *edge = new RoutingEdge(one, the_other);
+  RoutingEdge *edge = edge_pool_->New(one, the_other);
+  edge->set_cost(one->L1DistanceTo(the_other->centre()));
   edge->set_track(this);
   edge->first()->AddEdge(edge);
   edge->second()->AddEdge(edge);
@@ -150,62 +202,179 @@ bool RoutingTrack::MaybeAddEdgeBetween(
   return true;
 }
 
+RoutingEdge *RoutingTrack::FindEdgeBetween(
+    RoutingVertex *one, RoutingVertex *the_other) const {
+  for (RoutingEdge *edge : one->edges()) {
+    if (edge->track() != this)
+      continue;
+    if (edge->first() == the_other || edge->second() == the_other)
+      return edge;
+  }
+  return nullptr;
+}
+
 bool RoutingTrack::AddVertex(RoutingVertex *vertex) {
   LOG_IF(FATAL, IsBlocked(vertex->centre()))
       << "RoutingTrack cannot add vertex at " << vertex->centre()
       << ", it is blocked";
-  LOG_IF(FATAL, vertices_.find(vertex) != vertices_.end())
-      << "Duplicate vertex added to track";
+  int64_t position = ProjectOntoTrack(vertex->centre());
+  auto insertion = vertices_by_position_.insert({position, vertex});
+  LOG_IF(FATAL, !insertion.second)
+      << "Duplicate vertex position " << position << " added to track";
+  auto it = insertion.first;
+
+  RoutingVertex *before = it == vertices_by_position_.begin() ?
+      nullptr : std::prev(it)->second;
+  RoutingVertex *after = std::next(it) == vertices_by_position_.end() ?
+      nullptr : std::next(it)->second;
+
+  // The new vertex splits whatever edge spanned its neighbours.
+  if (before && after) {
+    RoutingEdge *spanning = FindEdgeBetween(before, after);
+    if (spanning)
+      RemoveEdge(spanning, true);
+  }
 
-  // Generate an edge between the new vertex and every other vertex, unless it
-  // would be blocked.
+  // Connect to the neighbours on either side, unless blocked. Longer straight
+  // runs are made by chaining these edges together.
   bool any_success = false;
-  for (RoutingVertex *other : vertices_) {
-    // We _don't want_ short-circuiting here.
-    any_success |= MaybeAddEdgeBetween(vertex, other);
-  }
-  vertices_.insert(vertex);
+  // We _don't want_ short-circuiting here.
+  if (before)
+    any_success |= MaybeAddEdgeBetween(before, vertex);
+  if (after)
+    any_success |= MaybeAddEdgeBetween(vertex, after);
   return any_success;
 }
 
 bool RoutingTrack::RemoveVertex(RoutingVertex *vertex) {
-  if (vertices_.erase(vertex) == 0) {
+  auto it = vertices_by_position_.find(ProjectOntoTrack(vertex->centre()));
+  if (it == vertices_by_position_.end() || it->second != vertex) {
     // We didn't know about this vertex.
     return false;
   }
 
-  for (RoutingEdge *edge : edges_) {
-    if (edge->first() == vertex || edge->second() == vertex)
+  RoutingVertex *before = it == vertices_by_position_.begin() ?
+      nullptr : std::prev(it)->second;
+  RoutingVertex *after = std::next(it) == vertices_by_position_.end() ?
+      nullptr : std::next(it)->second;
+  vertices_by_position_.erase(it);
+
+  // Only the edges to the neighbours can use this vertex.
+  if (before) {
+    RoutingEdge *edge = FindEdgeBetween(before, vertex);
+    if (edge)
+      RemoveEdge(edge, true);
+  }
+  if (after) {
+    RoutingEdge *edge = FindEdgeBetween(vertex, after);
+    if (edge)
       RemoveEdge(edge, true);
   }
+
+  // Rejoin the neighbours if the span between them is still clear, so that a
+  // straight run can continue past where the vertex was.
+  if (before && after)
+    MaybeAddEdgeBetween(before, after);
   return true;
 }
 
 void RoutingTrack::MarkEdgeAsUsed(RoutingEdge *edge,
                                   std::set<RoutingVertex*> *removed_vertices) {
-  if (edges_.find(edge) == edges_.end())
-    // Possible off-grid edge?
-    return;
+  MarkEdgesAsUsed({edge}, removed_vertices);
+}
 
-  CreateBlockage(edge->first()->centre(), edge->second()->centre());
+void RoutingTrack::MarkEdgesAsUsed(
+    const std::vector<RoutingEdge*> &edges,
+    std::set<RoutingVertex*> *removed_vertices) {
+  std::vector<std::pair<int64_t, int64_t>> spans;
+  for (RoutingEdge *edge : edges) {
+    // Remove the edge from our collection, if that hasn't been done already.
+    // It now belongs to the RoutingPath using it.
+    RemoveEdge(edge, false);
+    int64_t low = ProjectOntoTrack(edge->first()->centre());
+    int64_t high = ProjectOntoTrack(edge->second()->centre());
+    spans.emplace_back(std::min(low, high), std::max(low, high));
+  }
+  AddBlockages(spans);
 
-  // Remove the edge from our collection.
-  // Ownership of this edge is transferred to the RoutingPath that owns it.
-  RemoveEdge(edge, false);
+  for (const auto &span : spans)
+    InvalidateSpan(span.first, span.second, removed_vertices);
+}
 
-  // Remove other edges that are blocked by this.
-  for (RoutingEdge *edge : edges_) {
-    if (IsBlockedBetween(edge->first()->centre(), edge->second()->centre())) {
-      // Ownership of other blocked edges is not transferred; they are just
-      // removed.
-      RemoveEdge(edge, true);
+void RoutingTrack::MarkEdgesAsUnused(
+    const std::vector<RoutingEdge*> &edges,
+    std::set<RoutingVertex*> *joined_vertices) {
+  std::vector<std::pair<int64_t, int64_t>> spans;
+  for (RoutingEdge *edge : edges) {
+    int64_t low = ProjectOntoTrack(edge->first()->centre());
+    int64_t high = ProjectOntoTrack(edge->second()->centre());
+    spans.emplace_back(std::min(low, high), std::max(low, high));
+  }
+  RemoveBlockages(spans);
+
+  // As in InvalidateSpan, only consecutive vertices from the last one before
+  // each span to the first one after it can have lost an edge to it.
+  for (const auto &span : spans) {
+    auto it = vertices_by_position_.lower_bound(span.first);
+    if (it != vertices_by_position_.begin())
+      it = std::prev(it);
+    auto last = vertices_by_position_.upper_bound(span.second);
+    if (last != vertices_by_position_.end())
+      last = std::next(last);
+
+    RoutingVertex *previous = nullptr;
+    for (; it != last; ++it) {
+      RoutingVertex *vertex = it->second;
+      if (previous && FindEdgeBetween(previous, vertex) == nullptr &&
+          MaybeAddEdgeBetween(previous, vertex)) {
+        joined_vertices->insert(previous);
+        joined_vertices->insert(vertex);
+      }
+      previous = vertex;
     }
   }
+}
+
+void RoutingTrack::Restore(
+    const std::vector<RoutingVertex*> &vertices,
+    const std::vector<RoutingEdge*> &edges,
+    const std::vector<std::pair<int64_t, int64_t>> &blocked_spans) {
+  for (RoutingVertex *vertex : vertices) {
+    vertices_by_position_.emplace_hint(
+        vertices_by_position_.end(), ProjectOntoTrack(vertex->centre()),
+        vertex);
+  }
+  edges_.insert(edges.begin(), edges.end());
+  if (!blocked_spans.empty())
+    AddBlockages(blocked_spans);
+}
 
-  // Remove other vertices that are blocked by this.
-  for (RoutingVertex *vertex : vertices_) {
-    if (IsBlocked(vertex->centre()))
+void RoutingTrack::InvalidateSpan(
+    int64_t low, int64_t high, std::set<RoutingVertex*> *removed_vertices) {
+  // Only neighbouring vertices are joined by edges, so the only edges the
+  // span can block are those between consecutive vertices from the last one
+  // before it to the first one after it, and the only vertices are those in
+  // between.
+  auto it = vertices_by_position_.lower_bound(low);
+  if (it != vertices_by_position_.begin())
+    it = std::prev(it);
+  auto last = vertices_by_position_.upper_bound(high);
+  if (last != vertices_by_position_.end())
+    last = std::next(last);
+
+  RoutingVertex *previous = nullptr;
+  for (; it != last; ++it) {
+    RoutingVertex *vertex = it->second;
+    if (it->first >= low && it->first <= high)
       removed_vertices->insert(vertex);
+    if (previous) {
+      // Ownership of other blocked edges is not transferred; they are just
+      // removed.
+      RoutingEdge *edge = FindEdgeBetween(previous, vertex);
+      if (edge && IsBlockedBetween(previous->centre(), vertex->centre()))
+        RemoveEdge(edge, true);
+    }
+    previous = vertex;
   }
 }
 
@@ -236,10 +405,16 @@ RoutingVertex *RoutingTrack::CreateNearestVertexAndConnect(
   if (IsBlockedBetween(candidate_centre, target->centre()))
     return nullptr;
 
-  RoutingVertex *bridging_vertex = new RoutingVertex(candidate_centre);
+  // Some other vertex is already there. It is at least as close to the point
+  // as the target, so the caller will get to it as a candidate itself.
+  if (vertices_by_position_.find(ProjectOntoTrack(candidate_centre)) !=
+          vertices_by_position_.end())
+    return nullptr;
+
+  RoutingVertex *bridging_vertex = vertex_pool_->New(candidate_centre);
   if (!AddVertex(bridging_vertex)) {
     LOG(FATAL) << "I thought we made sure this couldn't happen already.";
-    delete bridging_vertex;
+    vertex_pool_->Delete(bridging_vertex);
     return nullptr;
   }
 
@@ -269,11 +444,64 @@ void RoutingTrack::ReportAvailableEdges(
 
 void RoutingTrack::ReportAvailableVertices(
     std::vector<RoutingVertex*> *vertices_out) {
-  std::copy_if(
-      vertices_.begin(),
-      vertices_.end(),
-      vertices_out->begin(),
-      [](RoutingVertex* vertex) { return vertex->available(); });
+  for (const auto &entry : vertices_by_position_) {
+    if (entry.second->available())
+      vertices_out->push_back(entry.second);
+  }
+}
+
+void RoutingTrack::ReportNeighbours(
+    RoutingVertex *vertex, std::vector<RoutingVertex*> *neighbours_out) const {
+  auto it = vertices_by_position_.find(ProjectOntoTrack(vertex->centre()));
+  if (it == vertices_by_position_.end() || it->second != vertex)
+    return;
+  if (it != vertices_by_position_.begin())
+    neighbours_out->push_back(std::prev(it)->second);
+  if (std::next(it) != vertices_by_position_.end())
+    neighbours_out->push_back(std::next(it)->second);
+}
+
+bool RoutingTrack::CanAddVertexAt(const Point &point) const {
+  return !IsBlocked(point) &&
+      vertices_by_position_.find(ProjectOntoTrack(point)) ==
+          vertices_by_position_.end();
+}
+
+RoutingVertex *RoutingTrack::VertexAt(const Point &point) const {
+  auto it = vertices_by_position_.find(ProjectOntoTrack(point));
+  if (it == vertices_by_position_.end() || !(it->second->centre() == point))
+    return nullptr;
+  return it->second;
+}
+
+bool RoutingTrack::EdgesBetween(
+    RoutingVertex *from, RoutingVertex *to,
+    std::vector<RoutingEdge*> *edges_out) const {
+  if (IsBlockedBetween(from->centre(), to->centre()))
+    return false;
+  int64_t low = ProjectOntoTrack(from->centre());
+  int64_t high = ProjectOntoTrack(to->centre());
+  bool reversed = low > high;
+  if (reversed)
+    std::swap(low, high);
+  auto it = vertices_by_position_.find(low);
+  auto last = vertices_by_position_.find(high);
+  if (it == vertices_by_position_.end() || last == vertices_by_position_.end())
+    return false;
+
+  // Even when nothing is blocked, a vertex taken out of the track (where
+  // another path crosses it) leaves its neighbours unjoined.
+  std::vector<RoutingEdge*> edges;
+  for (; it != last; ++it) {
+    RoutingEdge *edge = FindEdgeBetween(it->second, std::next(it)->second);
+    if (edge == nullptr)
+      return false;
+    edges.push_back(edge);
+  }
+  if (reversed)
+    std::reverse(edges.begin(), edges.end());
+  edges_out->insert(edges_out->end(), edges.begin(), edges.end());
+  return true;
 }
 
 std::string RoutingTrack::Debug() const {
@@ -293,10 +521,16 @@ std::string RoutingTrack::Debug() const {
      //<< " start=" << start_
      //<< " end=" << end_
      << " #edges=" << edges_.size() << " #vertices="
-     << vertices_.size();
+     << vertices_by_position_.size();
   return ss.str();
 }
 
+void RoutingTrack::SetPitch(int64_t start, int64_t pitch) {
+  occupancy_.SetPitch(start, pitch);
+  for (const RoutingTrackBlockage &blockage : blockages_)
+    occupancy_.Occupy(blockage.start(), blockage.end());
+}
+
 bool RoutingTrack::IsBlockedBetween(
     const Point &one_end, const Point &other_end) const {
   int64_t low = ProjectOntoTrack(one_end);
@@ -304,11 +538,23 @@ bool RoutingTrack::IsBlockedBetween(
   if (low > high)
     std::swap(low, high);
 
-  for (RoutingTrackBlockage *blockage : blockages_) {
-    if (blockage->Blocks(low, high)) return true;
+  switch (occupancy_.Query(low, high)) {
+    case RoutingTrackOccupancy::kFree:
+      return false;
+    case RoutingTrackOccupancy::kOccupied:
+      return true;
+    default:
+      break;
   }
-  // Does not overlap, start or stop in any blockages.
-  return false;
+
+  // The first blockage that does not end before the span is the only one
+  // that can overlap it.
+  auto it = std::lower_bound(
+      blockages_.begin(), blockages_.end(), low,
+      [](const RoutingTrackBlockage &blockage, int64_t position) {
+        return blockage.end() < position;
+      });
+  return it != blockages_.end() && it->start() <= high;
 }
 
 int64_t RoutingTrack::ProjectOntoTrack(const Point &point) const {
@@ -324,84 +570,127 @@ int64_t RoutingTrack::ProjectOntoTrack(const Point &point) const {
   return 0;
 }
 
-RoutingTrackBlockage *RoutingTrack::CreateBlockage(
-      const Point &one_end, const Point &other_end) {
-  int64_t low = ProjectOntoTrack(one_end);
-  int64_t high = ProjectOntoTrack(other_end);
-  if (low > high)
-    std::swap(low, high);
+void RoutingTrack::AddBlockage(int64_t low, int64_t high) {
+  blocked_spans_.emplace(low, high);
+  occupancy_.Occupy(low, high);
+  // Blockages from the first that does not end before low to the last that
+  // does not start after high overlap or touch the new one, and are merged
+  // into it.
+  auto first = std::lower_bound(
+      blockages_.begin(), blockages_.end(), low,
+      [](const RoutingTrackBlockage &blockage, int64_t position) {
+        return blockage.end() < position;
+      });
+  auto last = std::upper_bound(
+      first, blockages_.end(), high,
+      [](int64_t position, const RoutingTrackBlockage &blockage) {
+        return position < blockage.start();
+      });
+  if (first == last) {
+    blockages_.insert(first, RoutingTrackBlockage(low, high));
+    return;
+  }
+  first->set_start(std::min(low, first->start()));
+  first->set_end(std::max(high, std::prev(last)->end()));
+  blockages_.erase(std::next(first), last);
+}
 
-  if (blockages_.empty()) {
-    RoutingTrackBlockage *blockage = new RoutingTrackBlockage(low, high);
-    blockages_.push_back(blockage);
-    // Already sorted!
-    return blockage;
+void RoutingTrack::AddBlockages(
+    std::vector<std::pair<int64_t, int64_t>> spans) {
+  if (spans.size() == 1) {
+    AddBlockage(spans.front().first, spans.front().second);
+    return;
   }
-  // RoutingTrackBlockages should already be sorted in ascending order of
-  // position.
-  //
-  // TODO(aryap): I'm trying to find a range of consecutive values for which
-  // some predicate is true. I can't find a helpful standard library
-  // implementation that isn't just storing a bunch of iterators returned by
-  // subsequent calls to std::find_if. But since we need an iterator to remove
-  // elements from a vector, we have to store an iterator anyway.
-  auto first = blockages_.end();
-  auto last = blockages_.end();
-  for (auto it = blockages_.begin(); it != blockages_.end(); ++it) {
-    RoutingTrackBlockage *blockage = *it;
-    if (blockage->Blocks(low, high)) {
-      if (first == blockages_.end())
-        first = it;
-      else if (it == std::next(last)) {
-        // Extend the last iterator only if it is consecutive.
-        last = it;
-      }
+  // Merge the sorted spans and blockages in one pass.
+  std::sort(spans.begin(), spans.end());
+  blocked_spans_.insert(spans.begin(), spans.end());
+  for (const auto &span : spans)
+    occupancy_.Occupy(span.first, span.second);
+  std::vector<RoutingTrackBlockage> merged;
+  merged.reserve(blockages_.size() + spans.size());
+  auto add = [&](int64_t low, int64_t high) {
+    if (!merged.empty() && merged.back().end() >= low) {
+      merged.back().set_end(std::max(merged.back().end(), high));
+      return;
+    }
+    merged.emplace_back(low, high);
+  };
+  auto blockage = blockages_.begin();
+  auto span = spans.begin();
+  while (blockage != blockages_.end() || span != spans.end()) {
+    if (span == spans.end() ||
+        (blockage != blockages_.end() && blockage->start() < span->first)) {
+      add(blockage->start(), blockage->end());
+      ++blockage;
+    } else {
+      add(span->first, span->second);
+      ++span;
     }
   }
+  blockages_.swap(merged);
+}
 
-  if (first == blockages_.end()) {
-    // If no blockages were spanned the new blockage stands alone.
-    RoutingTrackBlockage *blockage = new RoutingTrackBlockage(low, high);
-    blockages_.push_back(blockage);
-    SortBlockages();
-    return blockage;
+void RoutingTrack::RemoveBlockages(
+    const std::vector<std::pair<int64_t, int64_t>> &spans) {
+  // Find the blockage each span was merged into, then forget the spans.
+  std::set<size_t> affected;
+  for (const auto &span : spans) {
+    auto blockage = std::lower_bound(
+        blockages_.begin(), blockages_.end(), span.first,
+        [](const RoutingTrackBlockage &blockage, int64_t position) {
+          return blockage.end() < position;
+        });
+    auto it = blocked_spans_.find(span);
+    LOG_IF(FATAL, it == blocked_spans_.end() ||
+                  blockage == blockages_.end() ||
+                  blockage->start() > span.first)
+        << "Span [" << span.first << ", " << span.second
+        << "] is not blocked on " << *this;
+    blocked_spans_.erase(it);
+    affected.insert(blockage - blockages_.begin());
   }
 
-  if (last == blockages_.end()) {
-    last = first;
+  // Rebuild each affected blockage from the spans still inside it. They can
+  // only have split, never grown.
+  std::vector<RoutingTrackBlockage> rebuilt;
+  rebuilt.reserve(blockages_.size() + spans.size());
+  std::vector<std::pair<int64_t, int64_t>> cleared;
+  for (size_t i = 0; i < blockages_.size(); ++i) {
+    const RoutingTrackBlockage &blockage = blockages_[i];
+    if (affected.find(i) == affected.end()) {
+      rebuilt.push_back(blockage);
+      continue;
+    }
+    cleared.emplace_back(blockage.start(), blockage.end());
+    size_t first_new = rebuilt.size();
+    for (auto it = blocked_spans_.lower_bound({blockage.start(),
+                                              blockage.start()});
+         it != blocked_spans_.end() && it->first <= blockage.end(); ++it) {
+      if (rebuilt.size() > first_new && rebuilt.back().end() >= it->first) {
+        rebuilt.back().set_end(std::max(rebuilt.back().end(), it->second));
+        continue;
+      }
+      rebuilt.emplace_back(it->first, it->second);
+    }
+  }
+  blockages_.swap(rebuilt);
+
+  // Clearing the old blockages' bits clears the whole intervals their ends
+  // were in, which blockages up to a pitch away might share.
+  int64_t pitch = occupancy_.pitch();
+  for (const auto &span : cleared) {
+    occupancy_.Clear(span.first, span.second);
+    auto blockage = std::lower_bound(
+        blockages_.begin(), blockages_.end(), span.first - pitch,
+        [](const RoutingTrackBlockage &blockage, int64_t position) {
+          return blockage.end() < position;
+        });
+    for (; blockage != blockages_.end() &&
+               blockage->start() <= span.second + pitch;
+         ++blockage) {
+      occupancy_.Occupy(blockage->start(), blockage->end());
+    }
   }
-
-  // Remove elements [first, last] from blockages after combining them into one
-  // blockage spanned by the new one. We rely on the sorted order of the blockages.
-  RoutingTrackBlockage *blockage = new RoutingTrackBlockage(
-      std::min(low, (*first)->start()),
-      std::max(high, (*last)->end()));
-
-  // Delete the old elements
-  ++last;
-  for (auto it = first; it != last; ++it)
-    delete *it;
-  blockages_.erase(first, last);
-
-  blockages_.push_back(blockage);
-  SortBlockages();
-  return blockage;
-}
-
-void RoutingTrack::SortBlockages() {
-  // Instead of declaring some
-  //   static bool CompareAsLess(
-  //       const RoutingTrackBlockage &a, const RoutingTrackBlockage &b) { ... };
-  // and passing &CompareAsLess with type
-  //       bool (*)(const RoutingTrackBlockage&, const RoutingTrackBlockage&)
-  // we get to use mOdErN c++. TODO(aryap): But if we made this a class member
-  // we wouldn't have to indirect through the getters/setters.
-  static auto comp = [](RoutingTrackBlockage *lhs,
-                        RoutingTrackBlockage *rhs) {
-    return lhs->start() != rhs->start() ?
-        lhs->start() < rhs->start() : lhs->end() < rhs->end();
-  };
-  std::sort(blockages_.begin(), blockages_.end(), comp);
 }
 
 std::ostream &operator<<(std::ostream &os, const RoutingTrack &track) {
@@ -409,7 +698,7 @@ std::ostream &operator<<(std::ostream &os, const RoutingTrack &track) {
   return os;
 }
 
-uint64_t RoutingVertex::L1DistanceTo(const Point &point) {
+uint64_t RoutingVertex::L1DistanceTo(const Point &point) const {
   // The L-1 norm, or Manhattan distance.
   int64_t dx = point.x() - centre_.x();
   int64_t dy = point.y() - centre_.y();
@@ -450,7 +739,24 @@ std::pair<std::reference_wrapper<const RoutingLayerInfo>,
 }
 
 RoutingVertex *RoutingGrid::GenerateGridVertexForPoint(
-    const Point &point, const Layer &layer) {
+    const Point &point, const Layer &layer, RoutingUndoLog *undo_log) {
+  auto start = std::chrono::steady_clock::now();
+  size_t num_logged = undo_log ? undo_log->vertices.size() : 0;
+  RoutingVertex *vertex = FindOrMakeGridVertexForPoint(point, layer, undo_log);
+  double seconds = SecondsSince(start);
+  for (RoutingPhaseStats *phase : CountedPhases()) {
+    ++phase->pin_accesses;
+    if (!vertex)
+      ++phase->pin_access_failures;
+    if (undo_log)
+      phase->pin_access_vertices += undo_log->vertices.size() - num_logged;
+    phase->pin_access_seconds += seconds;
+  }
+  return vertex;
+}
+
+RoutingVertex *RoutingGrid::FindOrMakeGridVertexForPoint(
+    const Point &point, const Layer &layer, RoutingUndoLog *undo_log) {
   // A key function of this class is to determine an appropriate starting point
   // on the routing grid for routing to/from an arbitrary point.
   //
@@ -465,28 +771,18 @@ RoutingVertex *RoutingGrid::GenerateGridVertexForPoint(
   // question of whether the vertex we find can be routed to.
   //
   // The first cut of this algorithm is to just find the closest of all the
-  // available vertices on the given layer.
+  // available vertices on the given layer. They are kept in a spatial index,
+  // so that we only look at those near the point.
+
+  // On a lazy grid, the nearest vertices have to exist first.
+  MaterialiseAround({point}, LazyRegionSize());
 
   auto it = available_vertices_by_layer_.find(layer);
   if (it == available_vertices_by_layer_.end()) {
     LOG(FATAL) << "Could not find a list of available vertices on layer: "
                << layer;
   }
-
-  if (it->second.empty())
-    return nullptr;
-
-  std::vector<std::pair<uint64_t, RoutingVertex*>> costed_vertices;
-  for (RoutingVertex *vertex : it->second) {
-    uint64_t vertex_cost = vertex->L1DistanceTo(point);
-    costed_vertices.emplace_back(vertex_cost, vertex);
-  }
-
-  // Should sort automatically based on operator< for first and second entries
-  // in pairs.
-  std::sort(costed_vertices.begin(),
-            costed_vertices.end(),
-            std::greater<std::pair<uint64_t, RoutingVertex*>>());
+  const RoutingVertexIndex &available = it->second;
 
   // To ensure we can go the "last mile", we check if the required paths, as
   // projected on the tracks on which the nearest vertex lies, are legal.
@@ -513,59 +809,114 @@ RoutingVertex *RoutingGrid::GenerateGridVertexForPoint(
   // vertices on legal tracks around the point so that they can be included in
   // the global shortest-path search. This would avoid having to turn corners
   // and go backwards, for example.
-  while (!costed_vertices.empty()) {
-    RoutingVertex *candidate = costed_vertices.back().second;
-    costed_vertices.pop_back();
-
-    // Try putting it on the vertical track and then horizontal track.
-    std::vector<RoutingTrack*> tracks = {
-      candidate->vertical_track(), candidate->horizontal_track()};
-    RoutingVertex *bridging_vertex = nullptr;
-    for (size_t i = 0; i < tracks.size() && bridging_vertex == nullptr; ++i) {
-      bridging_vertex = tracks[i]->CreateNearestVertexAndConnect(
-          point, candidate);
-    }
-    if (bridging_vertex == nullptr)
-      continue;
-
-    // TODO(aryap): Need a way to roll back this temporary objects in case the
-    // caller's entire process fails - i.e. a vertex can be created for the
-    // starting point but not for the ending point.
+  //
+  // Usually one of the nearest few vertices will do, so we only fetch more
+  // (in the same order) if they don't.
+  std::vector<RoutingVertex*> candidates;
+  size_t num_tried = 0;
+  size_t num_wanted = 4;
+  while (num_tried < available.size()) {
+    available.FindNearest(point, num_wanted, &candidates);
+    num_wanted *= 2;
+    for (; num_tried < candidates.size(); ++num_tried) {
+      RoutingVertex *candidate = candidates[num_tried];
+
+      // Try putting it on the vertical track and then horizontal track.
+      std::vector<RoutingTrack*> tracks = {
+        candidate->vertical_track(), candidate->horizontal_track()};
+      RoutingVertex *bridging_vertex = nullptr;
+      for (size_t i = 0;
+           i < tracks.size() && bridging_vertex == nullptr;
+           ++i) {
+        // Bridging and off-grid vertices are not on tracks in both directions.
+        if (tracks[i] == nullptr)
+          continue;
+        bridging_vertex = tracks[i]->CreateNearestVertexAndConnect(
+            point, candidate);
+      }
+      if (bridging_vertex == nullptr)
+        continue;
+
+      // Success, so add a new vertex at this position and the bridging one
+      // too.
+      if (bridging_vertex == candidate) {
+        // The closest vertex was the candidate itself, no bridging vertex
+        // necessary.
+        return bridging_vertex;
+      }
 
-    // Success, so add a new vertex at this position and the bridging one too.
-    if (bridging_vertex == candidate) {
-      // The closest vertex was the candidate itself, no bridging vertex necessary.
-      return bridging_vertex;
-    }
+      bridging_vertex->AddConnectedLayer(layer);
+      bridging_vertex->set_bridging(true);
+      AddVertex(bridging_vertex);
 
-    bridging_vertex->AddConnectedLayer(layer);
-    AddVertex(bridging_vertex);
+      RoutingVertex *off_grid = vertex_pool_.New(point);
+      off_grid->AddConnectedLayer(layer);
+      AddVertex(off_grid);
 
-    RoutingVertex *off_grid = new RoutingVertex(point);
-    off_grid->AddConnectedLayer(layer);
-    AddVertex(off_grid);
+      // These are only needed if the route they are for is made.
+      if (undo_log) {
+        undo_log->vertices.push_back(vertex_pool_.HandleOf(bridging_vertex));
+        undo_log->vertices.push_back(vertex_pool_.HandleOf(off_grid));
+      }
 
-    RoutingEdge *edge = new RoutingEdge(bridging_vertex, off_grid);
-    edge->set_layer(layer);
-    bridging_vertex->AddEdge(edge);
-    off_grid->AddEdge(edge);
+      RoutingEdge *edge = edge_pool_.New(bridging_vertex, off_grid);
+      edge->set_cost(bridging_vertex->L1DistanceTo(point));
+      edge->set_layer(layer);
+      bridging_vertex->AddEdge(edge);
+      off_grid->AddEdge(edge);
+      // The off-grid vertex had no edges when it was added.
+      off_grid->set_component(bridging_vertex->component());
     
-    // TODO(aryap): It's unclear what layer this edge is on. The opposite of
-    // what the bridging edge is on, I guess.
-    // TODO(aryap): It's not clear if the off-grid edge will be legal. We have
-    // to check with the whole grid.
+      // TODO(aryap): It's unclear what layer this edge is on. The opposite of
+      // what the bridging edge is on, I guess.
+      // TODO(aryap): It's not clear if the off-grid edge will be legal. We
+      // have to check with the whole grid.
 
-    off_grid_edges_.insert(edge);
-    return off_grid;
+      off_grid_edges_.insert(edge);
+      return off_grid;
+    }
   }
   return nullptr;
 }
 
-std::vector<RoutingVertex*> &RoutingGrid::GetAvailableVertices(
-    const Layer &layer) {
+void RoutingGrid::CountNet(const Port &port) {
+  counted_net_ = &stats_.nets[port.net()];
+}
+
+std::vector<RoutingPhaseStats*> RoutingGrid::CountedPhases() {
+  std::vector<RoutingPhaseStats*> phases = {&stats_.totals};
+  if (counted_net_)
+    phases.push_back(counted_net_);
+  return phases;
+}
+
+void RoutingGrid::CountSearch(const RoutingSearchStats &search_stats) {
+  for (RoutingPhaseStats *phase : CountedPhases()) {
+    ++phase->searches;
+    phase->vertices_expanded += search_stats.vertices_expanded;
+    phase->queue_pushes += search_stats.queue_pushes;
+    phase->stale_pops += search_stats.stale_pops;
+    phase->search_seconds += search_stats.seconds;
+  }
+}
+
+void RoutingGrid::RollBack(RoutingUndoLog *undo_log) {
+  for (auto it = undo_log->vertices.rbegin();
+       it != undo_log->vertices.rend(); ++it) {
+    RoutingVertex *vertex = vertex_pool_.Get(*it);
+    // Another net's path may have gone through (or used up) the vertex.
+    if (vertex == nullptr || vertex->path_count() > 0)
+      continue;
+    RemoveVertex(vertex, true);
+  }
+  undo_log->vertices.clear();
+}
+
+RoutingVertexIndex &RoutingGrid::GetAvailableVertices(const Layer &layer) {
   auto it = available_vertices_by_layer_.find(layer);
   if (it == available_vertices_by_layer_.end()) {
-    auto insert_it = available_vertices_by_layer_.insert({layer, {}});
+    auto insert_it = available_vertices_by_layer_.emplace(
+        layer, RoutingVertexIndex(vertex_index_cell_size_));
     LOG_IF(FATAL, !insert_it.second)
         << "Couldn't create entry for layer " << layer
         << " in available vertices map.";
@@ -591,6 +942,70 @@ int64_t modulo(int64_t a, int64_t b) {
 
 void RoutingGrid::ConnectLayers(
     const Layer &first, const Layer &second) {
+  auto start = std::chrono::steady_clock::now();
+  LazyConnection connection = MakeTracks(first, second);
+
+  // Generate a vertex at the intersection of every horizontal and vertical
+  // track.
+  size_t num_vertices = 0;
+  for (size_t i = 0; i < connection.xs.size(); ++i) {
+    for (size_t j = 0; j < connection.ys.size(); ++j) {
+      AddCrossing(connection, i, j);
+      ++num_vertices;
+    }
+  }
+
+  // The search will need to see all of this.
+  graph_stale_ = true;
+  components_valid_ = false;
+  stats_.vertices_built += num_vertices;
+  stats_.build_seconds += SecondsSince(start);
+
+  size_t num_edges = 0;
+  for (auto entry : tracks_by_layer_)
+    for (RoutingTrack *track : entry.second)
+      num_edges += track->edges().size();
+
+  LOG(INFO) << "Connected layer " << first << " and " << second << "; "
+            << "generated " << connection.ys.size() << " horizontal and "
+            << connection.xs.size() << " vertical tracks, "
+            << num_vertices << " vertices and "
+            << num_edges << " edges.";
+
+  for (auto entry : tracks_by_layer_) {
+    const Layer &layer = entry.first;
+    for (RoutingTrack *track : entry.second) {
+      VLOG(10) << layer << " track: " << *track;
+    }
+  }
+}
+
+void RoutingGrid::ConnectLayersLazily(
+    const Layer &first, const Layer &second, size_t region_tracks) {
+  auto start = std::chrono::steady_clock::now();
+  LazyConnection connection = MakeTracks(first, second);
+  connection.region_tracks = std::max(region_tracks, static_cast<size_t>(1));
+  connection.num_regions_x =
+      (connection.xs.size() + connection.region_tracks - 1) /
+      connection.region_tracks;
+  connection.num_regions_y =
+      (connection.ys.size() + connection.region_tracks - 1) /
+      connection.region_tracks;
+  connection.materialised.assign(
+      connection.num_regions_x * connection.num_regions_y, false);
+  connection.num_materialised = 0;
+
+  LOG(INFO) << "Connected layer " << first << " and " << second
+            << " lazily; generated " << connection.ys.size()
+            << " horizontal and " << connection.xs.size()
+            << " vertical tracks in " << connection.materialised.size()
+            << " regions";
+  lazy_connections_.push_back(std::move(connection));
+  stats_.build_seconds += SecondsSince(start);
+}
+
+RoutingGrid::LazyConnection RoutingGrid::MakeTracks(
+    const Layer &first, const Layer &second) {
   // One layer has to be horizontal, and one has to be vertical.
   auto split_directions = PickHorizontalAndVertical(first, second);
   const RoutingLayerInfo &horizontal_info = split_directions.first;
@@ -622,124 +1037,1354 @@ void RoutingGrid::ConnectLayers(
   int64_t y_start = y_min + (y_pitch - modulo(y_min - y_offset, y_pitch));
   int64_t y_max = overlap.upper_right().y();
 
-  std::vector<RoutingVertex*> &first_layer_vertices =
-      GetAvailableVertices(first);
-  std::vector<RoutingVertex*> &second_layer_vertices =
-      GetAvailableVertices(second);
+  LazyConnection connection;
+  connection.first = first;
+  connection.second = second;
 
-  size_t num_vertices = 0;
+  // Every vertex in the grid is a potential via between the two layers.
+  connection.via_cost = physical_db_.GetViaInfo(first, second).cost;
 
-  std::map<int64_t, RoutingTrack*> vertical_tracks;
-  std::map<int64_t, RoutingTrack*> horizontal_tracks;
+  // The available vertices are indexed in cells about a track apart.
+  vertex_index_cell_size_ = std::max(
+      vertex_index_cell_size_, std::max(x_pitch, y_pitch));
+  GetAvailableVertices(first);
+  GetAvailableVertices(second);
 
-  // Generate tracks to hold edges and vertices in each direction.
+  // Generate tracks to hold edges and vertices in each direction. The
+  // crossings on each are a pitch of the other direction apart.
   for (int64_t x = x_start; x < x_max; x += x_pitch) {
     RoutingTrack *track = new RoutingTrack(
-        vertical_info.layer, RoutingTrackDirection::kTrackVertical, x);
-    vertical_tracks.insert({x, track});
+        vertical_info.layer, RoutingTrackDirection::kTrackVertical, x,
+        &vertex_pool_, &edge_pool_);
+    track->SetPitch(y_start, y_pitch);
+    connection.xs.push_back(x);
+    connection.vertical_tracks.push_back(track);
     AddTrackToLayer(track, vertical_info.layer);
   }
 
   for (int64_t y = y_start; y < y_max; y += y_pitch) {
     RoutingTrack *track = new RoutingTrack(
-        horizontal_info.layer, RoutingTrackDirection::kTrackHorizontal, y);
-    horizontal_tracks.insert({y, track});
+        horizontal_info.layer, RoutingTrackDirection::kTrackHorizontal, y,
+        &vertex_pool_, &edge_pool_);
+    track->SetPitch(x_start, x_pitch);
+    connection.ys.push_back(y);
+    connection.horizontal_tracks.push_back(track);
     AddTrackToLayer(track, horizontal_info.layer);
   }
+  return connection;
+}
 
-  // Generate a vertex at the intersection of every horizontal and vertical
-  // track.
-  for (int64_t x = x_start; x < x_max; x += x_pitch) {
-    // This (and the horizontal one) must exist by now, so we can make this
-    // fatal.
-    RoutingTrack *vertical_track = vertical_tracks.find(x)->second;
+RoutingVertex *RoutingGrid::AddCrossing(
+    const LazyConnection &connection, size_t i, size_t j) {
+  RoutingTrack *vertical_track = connection.vertical_tracks[i];
+  RoutingTrack *horizontal_track = connection.horizontal_tracks[j];
 
-    for (int64_t y = y_start; y < y_max; y += y_pitch) {
-      RoutingTrack *horizontal_track = horizontal_tracks.find(y)->second;
+  RoutingVertex *vertex = vertex_pool_.New(
+      Point(connection.xs[i], connection.ys[j]));
+  vertex->set_horizontal_track(horizontal_track);
+  vertex->set_vertical_track(vertical_track);
+  vertex->set_cost(connection.via_cost);
 
-      RoutingVertex *vertex = new RoutingVertex(Point(x, y));
-      vertex->set_horizontal_track(horizontal_track);
-      vertex->set_vertical_track(vertical_track);
+  horizontal_track->AddVertex(vertex);
+  vertical_track->AddVertex(vertex);
 
-      horizontal_track->AddVertex(vertex);
-      vertical_track->AddVertex(vertex);
+  vertex->AddConnectedLayer(connection.first);
+  vertex->AddConnectedLayer(connection.second);
 
-      ++num_vertices;
-      vertex->AddConnectedLayer(first);
-      vertex->AddConnectedLayer(second);
+  AddVertex(vertex);
 
-      AddVertex(vertex);
+  VLOG(10) << "Vertex created: " << vertex->centre() << " on layers: "
+           << absl::StrJoin(vertex->connected_layers(), ", ");
+  return vertex;
+}
 
-      VLOG(10) << "Vertex created: " << vertex->centre() << " on layers: "
-               << absl::StrJoin(vertex->connected_layers(), ", ");
-      // TODO(aryap): Remove these.
+void RoutingGrid::Materialise(const Rectangle &area) {
+  auto start = std::chrono::steady_clock::now();
+  size_t regions_built = stats_.regions_built;
+  for (LazyConnection &connection : lazy_connections_) {
+    if (connection.num_materialised == connection.materialised.size())
+      continue;
+    // The tracks in the area, and so the regions they are in.
+    size_t first_x = std::lower_bound(
+        connection.xs.begin(), connection.xs.end(),
+        area.lower_left().x()) - connection.xs.begin();
+    size_t last_x = std::upper_bound(
+        connection.xs.begin(), connection.xs.end(),
+        area.upper_right().x()) - connection.xs.begin();
+    size_t first_y = std::lower_bound(
+        connection.ys.begin(), connection.ys.end(),
+        area.lower_left().y()) - connection.ys.begin();
+    size_t last_y = std::upper_bound(
+        connection.ys.begin(), connection.ys.end(),
+        area.upper_right().y()) - connection.ys.begin();
+    if (first_x >= last_x || first_y >= last_y)
+      continue;
+
+    size_t size = connection.region_tracks;
+    for (size_t region_y = first_y / size; region_y <= (last_y - 1) / size;
+         ++region_y) {
+      for (size_t region_x = first_x / size; region_x <= (last_x - 1) / size;
+           ++region_x) {
+        size_t region = region_y * connection.num_regions_x + region_x;
+        if (connection.materialised[region])
+          continue;
+        connection.materialised[region] = true;
+        ++connection.num_materialised;
+        ++stats_.regions_built;
+
+        size_t end_x = std::min((region_x + 1) * size, connection.xs.size());
+        size_t end_y = std::min((region_y + 1) * size, connection.ys.size());
+        for (size_t i = region_x * size; i < end_x; ++i) {
+          for (size_t j = region_y * size; j < end_y; ++j) {
+            Point centre(connection.xs[i], connection.ys[j]);
+            // Paths installed nearby, or the vertices joining ports to the
+            // grid, may already be there.
+            if (!connection.vertical_tracks[i]->CanAddVertexAt(centre) ||
+                !connection.horizontal_tracks[j]->CanAddVertexAt(centre))
+              continue;
+            AddCrossing(connection, i, j);
+            ++stats_.vertices_built;
+          }
+        }
+      }
     }
   }
+  // Most calls find everything already made.
+  if (stats_.regions_built != regions_built)
+    stats_.build_seconds += SecondsSince(start);
+}
 
-  size_t num_edges = 0;
-  for (auto entry : tracks_by_layer_)
-    for (RoutingTrack *track : entry.second)
-      num_edges += track->edges().size();
+void RoutingGrid::MaterialiseAroundNets(const std::vector<RoutingNet> &nets) {
+  std::vector<Point> centres;
+  for (const RoutingNet &net : nets) {
+    centres.push_back(net.first->centre());
+    centres.push_back(net.second->centre());
+  }
+  MaterialiseAround(centres, LazyRegionSize());
+}
 
-  LOG(INFO) << "Connected layer " << first << " and " << second << "; "
-            << "generated " << horizontal_tracks.size() << " horizontal and "
-            << vertical_tracks.size() << " vertical tracks, "
-            << num_vertices << " vertices and "
-            << num_edges << " edges.";
+bool RoutingGrid::FullyMaterialised() const {
+  for (const LazyConnection &connection : lazy_connections_) {
+    if (connection.num_materialised != connection.materialised.size())
+      return false;
+  }
+  return true;
+}
 
-  for (auto entry : tracks_by_layer_) {
-    const Layer &layer = entry.first;
-    for (RoutingTrack *track : entry.second) {
-      VLOG(10) << layer << " track: " << *track;
+void RoutingGrid::MaterialiseAround(
+    const std::vector<Point> &points, int64_t margin) {
+  if (lazy_connections_.empty() || points.empty())
+    return;
+  Point lower_left = points.front();
+  Point upper_right = points.front();
+  for (const Point &point : points) {
+    lower_left.set_x(std::min(lower_left.x(), point.x()));
+    lower_left.set_y(std::min(lower_left.y(), point.y()));
+    upper_right.set_x(std::max(upper_right.x(), point.x()));
+    upper_right.set_y(std::max(upper_right.y(), point.y()));
+  }
+  Materialise(Rectangle(
+      Point(lower_left.x() - margin, lower_left.y() - margin),
+      Point(upper_right.x() + margin, upper_right.y() + margin)));
+}
+
+int64_t RoutingGrid::LazyRegionSize() const {
+  int64_t size = 0;
+  for (const LazyConnection &connection : lazy_connections_) {
+    int64_t pitch = connection.xs.size() > 1 ?
+        connection.xs[1] - connection.xs[0] : 0;
+    if (connection.ys.size() > 1)
+      pitch = std::max(pitch, connection.ys[1] - connection.ys[0]);
+    size = std::max(
+        size, pitch * static_cast<int64_t>(connection.region_tracks));
+  }
+  return size;
+}
+
+bool RoutingGrid::MaybeConnected(RoutingVertex *begin, RoutingVertex *end) {
+  // Making more of a lazy grid can join what is there.
+  if (!FullyMaterialised())
+    return true;
+  if (!components_valid_)
+    LabelComponents();
+  return begin->component() == end->component();
+}
+
+void RoutingGrid::LabelComponents() {
+  static const size_t kUnlabelled = std::numeric_limits<size_t>::max();
+  for (RoutingVertex *vertex : vertices_)
+    vertex->set_component(kUnlabelled);
+  num_components_ = 0;
+  std::vector<RoutingVertex*> stack;
+  for (RoutingVertex *root : vertices_) {
+    if (root->component() != kUnlabelled)
+      continue;
+    size_t component = num_components_++;
+    root->set_component(component);
+    stack.push_back(root);
+    while (!stack.empty()) {
+      RoutingVertex *vertex = stack.back();
+      stack.pop_back();
+      for (RoutingEdge *edge : vertex->edges()) {
+        RoutingVertex *other =
+            edge->first() == vertex ? edge->second() : edge->first();
+        if (other->component() == kUnlabelled) {
+          other->set_component(component);
+          stack.push_back(other);
+        }
+      }
+    }
+  }
+  components_valid_ = true;
+  ++stats_.component_labellings;
+}
+
+void RoutingGrid::SplitComponent(RoutingVertex *root) {
+  if (!components_valid_)
+    return;
+  size_t component = num_components_++;
+  root->set_component(component);
+  std::vector<RoutingVertex*> stack = {root};
+  while (!stack.empty()) {
+    RoutingVertex *vertex = stack.back();
+    stack.pop_back();
+    for (RoutingEdge *edge : vertex->edges()) {
+      RoutingVertex *other =
+          edge->first() == vertex ? edge->second() : edge->first();
+      if (other->component() != component) {
+        other->set_component(component);
+        stack.push_back(other);
+      }
     }
   }
+  ++stats_.component_splits;
+}
+
+int64_t RoutingGrid::MaxPitch() const {
+  int64_t pitch = 0;
+  for (const auto &entry : tracks_by_layer_)
+    pitch = std::max(pitch, physical_db_.GetLayerInfo(entry.first).pitch);
+  return pitch;
 }
 
 void RoutingGrid::AddVertex(RoutingVertex *vertex) {
   for (const Layer &layer : vertex->connected_layers()) {
-    std::vector<RoutingVertex*> &available = GetAvailableVertices(layer);
-    available.push_back(vertex);
+    GetAvailableVertices(layer).Add(vertex);
   }
+  min_vertex_cost_ = std::min(min_vertex_cost_, vertex->cost());
+  vertex->set_grid_position(vertices_.size());
   vertices_.push_back(vertex);  // The class owns all of these.
+
+  // The vertex is in its neighbours' component, or a new one of its own. If
+  // it joins two components they must all be labelled again.
+  if (components_valid_) {
+    bool labelled = false;
+    for (RoutingEdge *edge : vertex->edges()) {
+      RoutingVertex *other =
+          edge->first() == vertex ? edge->second() : edge->first();
+      if (!labelled) {
+        vertex->set_component(other->component());
+        labelled = true;
+      } else if (other->component() != vertex->component()) {
+        components_valid_ = false;
+        break;
+      }
+    }
+    if (!labelled)
+      vertex->set_component(num_components_++);
+  }
+
+  if (!graph_stale_) {
+    graph_.AddVertex(vertex);
+    MarkNeighbourhoodDirty(vertex);
+  }
+}
+
+void RoutingGrid::MarkNeighbourhoodDirty(RoutingVertex *vertex) {
+  std::vector<RoutingVertex*> neighbours;
+  if (vertex->horizontal_track())
+    vertex->horizontal_track()->ReportNeighbours(vertex, &neighbours);
+  if (vertex->vertical_track())
+    vertex->vertical_track()->ReportNeighbours(vertex, &neighbours);
+  for (RoutingVertex *neighbour : neighbours)
+    graph_.MarkDirty(neighbour);
 }
 
-bool RoutingGrid::AddRouteBetween(const Port &begin, const Port &end) {
+void RoutingGrid::RefreshGraph() {
+  if (graph_stale_) {
+    graph_.Rebuild(vertices_);
+    graph_stale_ = false;
+    return;
+  }
+  graph_.Flush();
+}
+
+bool RoutingGrid::AddRouteBetween(
+    const Port &begin, const Port &end, const RoutingSearchOptions &options,
+    RoutingSearchStats *stats) {
+  RoutingSearchStats search_stats;
+  bool routed = RouteBetween(begin, end, options, &search_stats);
+  if (stats)
+    *stats = search_stats;
+
+  if (!routed) {
+    LOG(WARNING) << "No path found between " << begin.centre() << " and "
+                 << end.centre();
+    return false;
+  }
+  VLOG(1) << "Found path with cost " << search_stats.path_cost
+          << " after expanding " << search_stats.vertices_expanded
+          << " vertices";
+  return true;
+}
+
+bool RoutingGrid::AddMultiPointRoute(
+    const std::vector<const Port*> &ports,
+    const RoutingSearchOptions &options,
+    RoutingSearchStats *stats) {
+  RoutingSearchStats tree_stats;
+  bool all_connected = true;
+  if (ports.empty()) {
+    if (stats)
+      *stats = tree_stats;
+    return all_connected;
+  }
+  CountNet(*ports.front());
+
+  // On a lazy grid, the tree can use anything around its ports.
+  std::vector<Point> centres;
+  for (const Port *port : ports)
+    centres.push_back(port->centre());
+  MaterialiseAround(centres, LazyRegionSize());
+
+  // Each port is only given its vertex just before the tree is searched for
+  // it, so that ports not yet connected leave their bridging vertices out of
+  // the way of the branches found before them. Those vertices are taken out
+  // again if the port cannot be reached.
+  std::vector<RoutingUndoLog> undo_logs(ports.size());
+
+  // The tree grows from the first port that can be given a vertex.
+  std::vector<bool> done(ports.size(), false);
+  RoutingVertex *root = nullptr;
+  size_t root_port = 0;
+  for (; root_port < ports.size() && !root; ++root_port) {
+    done[root_port] = true;
+    root = GenerateGridVertexForPoint(
+        ports[root_port]->centre(), ports[root_port]->layer(),
+        &undo_logs[root_port]);
+    if (!root) {
+      LOG(WARNING) << "Could not find available vertex for port at "
+                   << ports[root_port]->centre();
+      all_connected = false;
+    }
+  }
+  if (!root) {
+    StopCountingNet();
+    if (stats)
+      *stats = tree_stats;
+    return all_connected;
+  }
+  --root_port;
+
+  // The vertices of the tree so far, from any of which the next search can
+  // start.
+  std::vector<RoutingVertex*> tree = {root};
+  std::set<RoutingVertex*> in_tree = {root};
+
+  // Each branch is kept as the vertices it visits, and only made into a path
+  // once the tree is complete: vertices added for later ports can split the
+  // edges between them.
+  struct Branch {
+    const Port *port;
+    std::vector<RoutingVertex*> vertices;
+  };
+  std::vector<Branch> branches;
+
+  // For each port not yet dealt with, its L1 distance to the nearest vertex in
+  // the tree. This is updated with only the new vertices as the tree grows.
+  std::vector<uint64_t> distances(
+      ports.size(), std::numeric_limits<uint64_t>::max());
+  auto update_distances = [&](size_t first_new) {
+    for (size_t i = 0; i < ports.size(); ++i) {
+      if (done[i])
+        continue;
+      for (size_t j = first_new; j < tree.size(); ++j) {
+        distances[i] = std::min(
+            distances[i], tree[j]->L1DistanceTo(ports[i]->centre()));
+      }
+    }
+  };
+  update_distances(0);
+
+  while (true) {
+    size_t next = ports.size();
+    for (size_t i = 0; i < ports.size(); ++i) {
+      if (!done[i] && (next == ports.size() ||
+                       distances[i] < distances[next])) {
+        next = i;
+      }
+    }
+    if (next == ports.size())
+      break;
+    done[next] = true;
+
+    const Port *port = ports[next];
+    RoutingVertex *terminal = GenerateGridVertexForPoint(
+        port->centre(), port->layer(), &undo_logs[next]);
+    if (!terminal) {
+      LOG(WARNING) << "Could not find available vertex for port at "
+                   << port->centre();
+      all_connected = false;
+      continue;
+    }
+    // The port may land on the tree already.
+    if (in_tree.find(terminal) != in_tree.end())
+      continue;
+
+    // This also gives the new vertices their indices.
+    RefreshGraph();
+
+    RoutingSearchStats search_stats;
+    std::vector<size_t> slots;
+    RoutingVertex *branch_begin = nullptr;
+    bool found = FindShortestPath(tree, terminal, options,
+                                  RoutingSearchLimits(), &workspace_,
+                                  &search_stats, &slots, &branch_begin);
+    CountSearch(search_stats);
+    AddSearchCounters(search_stats, &tree_stats);
+    if (!found || slots.empty()) {
+      LOG(WARNING) << "No path found to port at " << port->centre();
+      all_connected = false;
+      RollBack(&undo_logs[next]);
+      continue;
+    }
+    tree_stats.path_cost += search_stats.path_cost;
+
+    Branch branch = {port, {branch_begin}};
+    for (size_t slot : slots)
+      branch.vertices.push_back(graph_.vertex(graph_.target(slot)));
+    VLOG(1) << "Found branch from " << branch_begin->centre() << " to "
+            << port->centre();
+
+    size_t first_new = tree.size();
+    for (RoutingVertex *vertex : branch.vertices) {
+      if (in_tree.insert(vertex).second)
+        tree.push_back(vertex);
+    }
+    branches.push_back(branch);
+    update_distances(first_new);
+  }
+
+  // Where a later port's vertex went onto an earlier branch, the later branch
+  // can start along the earlier one before leaving it. Edges are only
+  // installed once, so a branch is cut into pieces around those it shares.
+  std::vector<RoutingPath*> paths;
+  std::set<RoutingEdge*> used_edges;
+  for (const Branch &branch : branches) {
+    std::vector<RoutingEdge*> edges;
+    bool joined = EdgesThrough(branch.vertices, &edges);
+    LOG_IF(FATAL, !joined)
+        << "Branch to port at " << branch.port->centre()
+        << " is no longer joined";
+    RoutingVertex *piece_begin = branch.vertices.front();
+    RoutingVertex *last = piece_begin;
+    std::deque<RoutingEdge*> piece;
+    for (size_t i = 0; i <= edges.size(); ++i) {
+      RoutingVertex *next_vertex = nullptr;
+      bool shared = false;
+      if (i < edges.size()) {
+        next_vertex = edges[i]->first() == last ?
+            edges[i]->second() : edges[i]->first();
+        shared = !used_edges.insert(edges[i]).second;
+        if (!shared)
+          piece.push_back(edges[i]);
+      }
+      if ((shared || i == edges.size()) && !piece.empty()) {
+        RoutingPath *path = new RoutingPath(piece_begin, piece);
+        path->set_start_port(paths.empty() ? ports[root_port] : nullptr);
+        path->set_end_port(i == edges.size() ? branch.port : nullptr);
+        VLOG(1) << "Found branch: " << *path;
+        paths.push_back(path);
+        piece.clear();
+      }
+      if (shared)
+        piece_begin = next_vertex;
+      last = next_vertex;
+    }
+  }
+
+  if (!paths.empty())
+    InstallPaths(paths);
+
+  // The ends of ports that were connected are now in the tree, and so are
+  // left alone; the rest are taken out.
+  for (RoutingUndoLog &undo_log : undo_logs) {
+    RollBack(&undo_log);
+  }
+  StopCountingNet();
+
+  LOG(INFO) << "Connected " << ports.size() << " ports with "
+            << branches.size() << " branches of total cost "
+            << tree_stats.path_cost << " after expanding "
+            << tree_stats.vertices_expanded << " vertices";
+  if (stats)
+    *stats = tree_stats;
+  return all_connected;
+}
+
+std::vector<size_t> RoutingGrid::OrderNets(
+    const std::vector<RoutingNet> &nets, const RoutingNetOrder &order) {
+  std::vector<size_t> indices(nets.size());
+  for (size_t i = 0; i < nets.size(); ++i)
+    indices[i] = i;
+  if (order == RoutingNetOrder::kNetOrderGiven)
+    return indices;
+
+  std::vector<uint64_t> half_perimeters(nets.size());
+  for (size_t i = 0; i < nets.size(); ++i) {
+    const Point &begin = nets[i].first->centre();
+    const Point &end = nets[i].second->centre();
+    half_perimeters[i] = std::abs(end.x() - begin.x()) +
+                         std::abs(end.y() - begin.y());
+  }
+
+  std::map<std::string, size_t> pairs_by_net;
+  if (order == RoutingNetOrder::kNetOrderFanOut) {
+    for (const RoutingNet &net : nets)
+      ++pairs_by_net[net.first->net()];
+  }
+  auto fan_out = [&](size_t i) {
+    auto it = pairs_by_net.find(nets[i].first->net());
+    return it == pairs_by_net.end() ? 0 : it->second;
+  };
+
+  // A stable sort keeps the result deterministic, and otherwise in the given
+  // order.
+  std::stable_sort(indices.begin(), indices.end(), [&](size_t a, size_t b) {
+    if (order == RoutingNetOrder::kNetOrderFanOut &&
+        fan_out(a) != fan_out(b)) {
+      return fan_out(a) > fan_out(b);
+    }
+    return half_perimeters[a] < half_perimeters[b];
+  });
+  return indices;
+}
+
+size_t RoutingGrid::AddRoutesBetween(
+    const std::vector<RoutingNet> &nets,
+    const RoutingNetOrder &order,
+    const RoutingSearchOptions &options,
+    std::vector<RoutingNetResult> *results) {
+  results->assign(nets.size(), RoutingNetResult());
+
+  size_t num_routed = 0;
+  size_t num_expanded = 0;
+  for (size_t i : OrderNets(nets, order)) {
+    RoutingNetResult &result = (*results)[i];
+    result.routed = RouteBetween(
+        *nets[i].first, *nets[i].second, options, &result.stats);
+    if (result.routed)
+      ++num_routed;
+    num_expanded += result.stats.vertices_expanded;
+  }
+
+  LOG(INFO) << "Routed " << num_routed << " of " << nets.size()
+            << " nets after expanding " << num_expanded << " vertices";
+  return num_routed;
+}
+
+size_t RoutingGrid::AddRoutesByNegotiation(
+    const std::vector<RoutingNet> &nets,
+    const NegotiatedRoutingOptions &options,
+    std::vector<RoutingNetResult> *results,
+    NegotiatedRoutingStats *stats) {
+  NegotiatedRoutingStats negotiation_stats;
+  results->assign(nets.size(), RoutingNetResult());
+  std::vector<size_t> order = OrderNets(nets, options.order);
+
+  struct NetState {
+    RoutingVertex *begin = nullptr;
+    RoutingVertex *end = nullptr;
+    RoutingUndoLog undo_log;
+    bool routable = false;
+    // The net's current path: the vertices it visits (including both ends),
+    // their indices in graph_, and the slots of the edges between them.
+    std::vector<RoutingVertex*> vertices;
+    std::vector<size_t> indices;
+    std::vector<size_t> slots;
+    // The congestion resources it uses, each once.
+    std::vector<size_t> resources;
+  };
+  std::vector<NetState> net_states(nets.size());
+
+  // Nothing may be added to the grid once negotiation starts, so on a lazy
+  // grid everything around the nets is made now.
+  MaterialiseAroundNets(nets);
+
+  // The ends of every net stay put for the whole negotiation, so they are all
+  // made up front. Nothing may change the grid after this until the paths are
+  // installed, since congestion is tracked by index into graph_.
+  for (size_t i : order) {
+    NetState &net = net_states[i];
+    CountNet(*nets[i].first);
+    net.begin = GenerateGridVertexForPoint(
+        nets[i].first->centre(), nets[i].first->layer(), &net.undo_log);
+    net.end = net.begin ? GenerateGridVertexForPoint(
+        nets[i].second->centre(), nets[i].second->layer(), &net.undo_log) :
+        nullptr;
+    net.routable = net.begin != nullptr && net.end != nullptr;
+    if (!net.routable) {
+      LOG(WARNING) << "Could not find available vertices for net between "
+                   << nets[i].first->centre() << " and "
+                   << nets[i].second->centre();
+      RollBack(&net.undo_log);
+    }
+  }
+  RefreshGraph();
+  size_t graph_size = graph_.size();
+
+  RoutingCongestion congestion;
+  congestion.Reset(2 * graph_size);
+  congestion.set_present_factor(options.initial_present_factor);
+
+  auto rip_up = [&](NetState *net) {
+    for (size_t resource : net->resources)
+      congestion.Release(resource);
+    net->vertices.clear();
+    net->indices.clear();
+    net->slots.clear();
+    net->resources.clear();
+  };
+  auto route = [&](size_t i) {
+    NetState &net = net_states[i];
+    RoutingSearchStats &net_stats = (*results)[i].stats;
+    CountNet(*nets[i].first);
+    RoutingSearchStats search_stats;
+    RoutingSearchLimits limits;
+    limits.congestion = &congestion;
+    bool found = FindShortestPath({net.begin}, net.end, options.search,
+                                  limits, &workspace_, &search_stats,
+                                  &net.slots);
+    LOG_IF(FATAL, graph_.size() != graph_size)
+        << "The grid changed during negotiation";
+    ++negotiation_stats.searches;
+    negotiation_stats.vertices_expanded += search_stats.vertices_expanded;
+    AddSearchCounters(search_stats, &net_stats);
+    CountSearch(search_stats);
+
+    // Sharing does not create any new edges, so a net that cannot be routed
+    // now never will be.
+    if (!found || net.slots.empty()) {
+      net.routable = false;
+      net.slots.clear();
+      return;
+    }
+    // The ends are taken whole, since nothing can cross a vertex that a path
+    // turns or stops at.
+    for (RoutingVertex *vertex : {net.begin, net.end}) {
+      net.resources.push_back(2 * vertex->contextual_index());
+      net.resources.push_back(2 * vertex->contextual_index() + 1);
+    }
+    size_t index = net.begin->contextual_index();
+    net.indices.push_back(index);
+    for (size_t slot : net.slots) {
+      // An edge uses the track in its direction at both of its ends. (So a
+      // turn takes both tracks.)
+      size_t direction = static_cast<size_t>(graph_.edge_direction(slot));
+      net.resources.push_back(2 * index + direction);
+      index = graph_.target(slot);
+      net.resources.push_back(2 * index + direction);
+      net.indices.push_back(index);
+    }
+    for (size_t index : net.indices)
+      net.vertices.push_back(graph_.vertex(index));
+    std::sort(net.resources.begin(), net.resources.end());
+    net.resources.erase(
+        std::unique(net.resources.begin(), net.resources.end()),
+        net.resources.end());
+    for (size_t resource : net.resources)
+      congestion.Occupy(resource);
+  };
+  auto overused = [&](const NetState &net) {
+    for (size_t resource : net.resources) {
+      if (congestion.Overused(resource))
+        return true;
+    }
+    return false;
+  };
+
+  for (size_t iteration = 1; iteration <= options.max_iterations;
+       ++iteration) {
+    for (size_t i : order) {
+      NetState &net = net_states[i];
+      if (!net.routable)
+        continue;
+      // After the first iteration, only the nets in conflict are rerouted.
+      if (iteration > 1 && !overused(net))
+        continue;
+      rip_up(&net);
+      route(i);
+    }
+
+    size_t num_overused = congestion.UpdateHistory(options.history_increment);
+    negotiation_stats.iterations = iteration;
+    negotiation_stats.overused_resources.push_back(num_overused);
+    VLOG(1) << "Negotiation iteration " << iteration << ": " << num_overused
+            << " overused resources";
+    if (num_overused == 0) {
+      negotiation_stats.converged = true;
+      break;
+    }
+    congestion.set_present_factor(
+        congestion.present_factor() * options.present_factor_growth);
+  }
+
+  // Install the negotiated paths. Removing the vertices of installed paths
+  // does not renumber graph_, so the others' indices stay good. If
+  // negotiation did not converge, nets still in conflict are routed again
+  // afterwards on what is left, as AddRoutesBetween would.
+  std::vector<size_t> collided;
+  for (size_t i : order) {
+    NetState &net = net_states[i];
+    if (!net.routable)
+      continue;
+    if (overused(net)) {
+      collided.push_back(i);
+      continue;
+    }
+    double cost = PathCost(net.indices.front(), net.slots);
+    RoutingPath *path = RebuildPath(net.vertices, net.indices, net.slots);
+    if (!path) {
+      collided.push_back(i);
+      continue;
+    }
+    (*results)[i].stats.path_cost = cost;
+    path->set_start_port(nets[i].first);
+    path->set_end_port(nets[i].second);
+    CountNet(*nets[i].first);
+    InstallPath(path);
+    (*results)[i].routed = true;
+  }
+  // Nets that were not installed leave nothing behind. Those in conflict get
+  // new ends when they are routed again.
+  for (size_t i : order) {
+    if (!(*results)[i].routed)
+      RollBack(&net_states[i].undo_log);
+  }
+  for (size_t i : collided) {
+    RoutingSearchStats search_stats;
+    (*results)[i].routed = RouteBetween(
+        *nets[i].first, *nets[i].second, options.search, &search_stats);
+    AddSearchCounters(search_stats, &(*results)[i].stats);
+    (*results)[i].stats.path_cost = search_stats.path_cost;
+    ++negotiation_stats.searches;
+    negotiation_stats.vertices_expanded += search_stats.vertices_expanded;
+  }
+  negotiation_stats.nets_rerouted = collided.size();
+  StopCountingNet();
+
+  size_t num_routed = 0;
+  for (const RoutingNetResult &result : *results) {
+    if (result.routed)
+      ++num_routed;
+  }
+  LOG(INFO) << "Routed " << num_routed << " of " << nets.size()
+            << " nets by negotiation in " << negotiation_stats.iterations
+            << " iterations (" << (negotiation_stats.converged ?
+                                   "converged" : "did not converge")
+            << ") and " << negotiation_stats.searches << " searches";
+  if (stats)
+    *stats = negotiation_stats;
+  return num_routed;
+}
+
+size_t RoutingGrid::AddRoutesInTiles(
+    const std::vector<RoutingNet> &nets,
+    const TiledRoutingOptions &options,
+    std::vector<RoutingNetResult> *results,
+    TiledRoutingStats *stats) {
+  TiledRoutingStats tiled_stats;
+  results->assign(nets.size(), RoutingNetResult());
+  std::vector<size_t> order = OrderNets(nets, options.order);
+
+  struct TileNet {
+    size_t net;
+    RoutingVertex *begin;
+    RoutingVertex *end;
+    bool found = false;
+    std::vector<RoutingVertex*> vertices;
+    std::vector<size_t> indices;
+    std::vector<size_t> slots;
+  };
+  std::vector<std::vector<TileNet>> tile_nets;
+  std::vector<bool> remaining(nets.size(), false);
+
+  // As for negotiation, the tiles need everything they might use made first.
+  MaterialiseAroundNets(nets);
+
+  // The ends of every net are made up front, serially. Nothing may change the
+  // grid after this until the tiles are done, since the workers share graph_.
+  std::vector<std::pair<RoutingVertex*, RoutingVertex*>> ends(nets.size());
+  std::vector<RoutingUndoLog> undo_logs(nets.size());
+  for (size_t i : order) {
+    CountNet(*nets[i].first);
+    ends[i].first = GenerateGridVertexForPoint(
+        nets[i].first->centre(), nets[i].first->layer(), &undo_logs[i]);
+    ends[i].second = ends[i].first ? GenerateGridVertexForPoint(
+        nets[i].second->centre(), nets[i].second->layer(), &undo_logs[i]) :
+        nullptr;
+  }
+  RefreshGraph();
+
+  // Split the bounding box of the grid into tiles. Tiles include their
+  // boundaries, so they must not overlap.
+  std::vector<Rectangle> tiles;
+  if (!vertices_.empty()) {
+    Point lower_left = vertices_.front()->centre();
+    Point upper_right = lower_left;
+    for (RoutingVertex *vertex : vertices_) {
+      const Point &centre = vertex->centre();
+      lower_left.set_x(std::min(lower_left.x(), centre.x()));
+      lower_left.set_y(std::min(lower_left.y(), centre.y()));
+      upper_right.set_x(std::max(upper_right.x(), centre.x()));
+      upper_right.set_y(std::max(upper_right.y(), centre.y()));
+    }
+    int64_t num_x = std::max(options.num_tiles_x, static_cast<size_t>(1));
+    int64_t num_y = std::max(options.num_tiles_y, static_cast<size_t>(1));
+    int64_t width =
+        (upper_right.x() - lower_left.x() + num_x) / num_x;
+    int64_t height =
+        (upper_right.y() - lower_left.y() + num_y) / num_y;
+    for (int64_t j = 0; j < num_y; ++j) {
+      for (int64_t i = 0; i < num_x; ++i) {
+        Point tile_lower_left(lower_left.x() + i * width,
+                              lower_left.y() + j * height);
+        tiles.emplace_back(
+            tile_lower_left,
+            Point(tile_lower_left.x() + width - 1,
+                  tile_lower_left.y() + height - 1));
+      }
+    }
+    tile_nets.resize(tiles.size());
+
+    auto tile_of = [&](const Point &point) {
+      int64_t i = (point.x() - lower_left.x()) / width;
+      int64_t j = (point.y() - lower_left.y()) / height;
+      return static_cast<size_t>(j * num_x + i);
+    };
+    for (size_t i : order) {
+      RoutingVertex *begin = ends[i].first;
+      RoutingVertex *end = ends[i].second;
+      if (!begin || !end) {
+        remaining[i] = true;
+        continue;
+      }
+      size_t tile = tile_of(begin->centre());
+      if (tile_of(end->centre()) != tile) {
+        remaining[i] = true;
+        continue;
+      }
+      TileNet tile_net;
+      tile_net.net = i;
+      tile_net.begin = begin;
+      tile_net.end = end;
+      tile_nets[tile].push_back(tile_net);
+    }
+  }
+  tiled_stats.num_tiles = tiles.size();
+
+  // A resource (see RoutingCongestion) is taken once a net in its tile uses
+  // it. The ends of all the nets are taken before any are routed, so that no
+  // net blocks another's end. Since searches never leave their tile, each
+  // worker only ever touches the entries for its own tile.
+  std::vector<uint8_t> taken(2 * graph_.size(), 0);
+  for (const std::vector<TileNet> &nets_in_tile : tile_nets) {
+    for (const TileNet &tile_net : nets_in_tile) {
+      for (RoutingVertex *vertex : {tile_net.begin, tile_net.end}) {
+        taken[2 * vertex->contextual_index()] = 1;
+        taken[2 * vertex->contextual_index() + 1] = 1;
+      }
+    }
+  }
+
+  std::vector<RoutingSearchStats> search_stats(nets.size());
+  std::atomic<size_t> next_tile(0);
+  auto route_tiles = [&]() {
+    RoutingSearchWorkspace workspace;
+    for (size_t tile = next_tile++; tile < tiles.size(); tile = next_tile++) {
+      RoutingSearchLimits limits;
+      limits.window = &tiles[tile];
+      limits.taken = &taken;
+      for (TileNet &tile_net : tile_nets[tile]) {
+        tile_net.found = FindShortestPath(
+            {tile_net.begin}, tile_net.end, options.search, limits,
+            &workspace, &search_stats[tile_net.net], &tile_net.slots) &&
+            !tile_net.slots.empty();
+        if (!tile_net.found)
+          continue;
+        size_t index = tile_net.begin->contextual_index();
+        tile_net.indices.push_back(index);
+        for (size_t slot : tile_net.slots) {
+          size_t direction = static_cast<size_t>(graph_.edge_direction(slot));
+          taken[2 * index + direction] = 1;
+          index = graph_.target(slot);
+          taken[2 * index + direction] = 1;
+          tile_net.indices.push_back(index);
+        }
+        for (size_t index : tile_net.indices)
+          tile_net.vertices.push_back(graph_.vertex(index));
+      }
+    }
+  };
+  size_t num_threads = std::min(
+      std::max(options.num_threads, static_cast<size_t>(1)), tiles.size());
+  if (num_threads <= 1) {
+    route_tiles();
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i)
+      threads.emplace_back(route_tiles);
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+
+  // Install the tiles' paths serially. As in AddRoutesByNegotiation, removing
+  // the vertices of installed paths does not renumber graph_.
+  for (const std::vector<TileNet> &nets_in_tile : tile_nets) {
+    for (const TileNet &tile_net : nets_in_tile) {
+      size_t i = tile_net.net;
+      RoutingNetResult &result = (*results)[i];
+      result.stats = search_stats[i];
+      tiled_stats.vertices_expanded += search_stats[i].vertices_expanded;
+      // The workers' searches are only counted now, one at a time.
+      CountNet(*nets[i].first);
+      CountSearch(search_stats[i]);
+      RoutingPath *path = tile_net.found ? RebuildPath(
+          tile_net.vertices, tile_net.indices, tile_net.slots) : nullptr;
+      if (!path) {
+        remaining[i] = true;
+        continue;
+      }
+      result.stats.path_cost = PathCost(tile_net.indices.front(),
+                                        tile_net.slots);
+      path->set_start_port(nets[i].first);
+      path->set_end_port(nets[i].second);
+      InstallPath(path);
+      result.routed = true;
+      ++tiled_stats.tile_nets_routed;
+    }
+  }
+
+  // Then whatever is left, in the original order. Their ends are made again
+  // for them, so the ones made for the tiles are taken out.
+  std::vector<size_t> remaining_nets;
+  for (size_t i : order) {
+    if (!remaining[i])
+      continue;
+    RollBack(&undo_logs[i]);
+    remaining_nets.push_back(i);
+  }
+  tiled_stats.remaining_nets = remaining_nets.size();
+  if (options.negotiate_remaining_nets) {
+    std::vector<RoutingNet> nets_left;
+    for (size_t i : remaining_nets)
+      nets_left.push_back(nets[i]);
+    NegotiatedRoutingOptions negotiation = options.negotiation;
+    negotiation.search = options.search;
+    negotiation.order = RoutingNetOrder::kNetOrderGiven;
+    std::vector<RoutingNetResult> results_left;
+    tiled_stats.remaining_nets_routed = AddRoutesByNegotiation(
+        nets_left, negotiation, &results_left);
+    for (size_t j = 0; j < remaining_nets.size(); ++j) {
+      RoutingNetResult &result = (*results)[remaining_nets[j]];
+      result.routed = results_left[j].routed;
+      AddSearchCounters(results_left[j].stats, &result.stats);
+      result.stats.path_cost = results_left[j].stats.path_cost;
+      tiled_stats.vertices_expanded += results_left[j].stats.vertices_expanded;
+    }
+  } else {
+    for (size_t i : remaining_nets) {
+      RoutingNetResult &result = (*results)[i];
+      RoutingSearchStats route_stats;
+      result.routed = RouteBetween(
+          *nets[i].first, *nets[i].second, options.search, &route_stats);
+      AddSearchCounters(route_stats, &result.stats);
+      result.stats.path_cost = route_stats.path_cost;
+      tiled_stats.vertices_expanded += route_stats.vertices_expanded;
+      if (result.routed)
+        ++tiled_stats.remaining_nets_routed;
+    }
+  }
+
+  StopCountingNet();
+  size_t num_routed =
+      tiled_stats.tile_nets_routed + tiled_stats.remaining_nets_routed;
+  LOG(INFO) << "Routed " << num_routed << " of " << nets.size()
+            << " nets in " << tiled_stats.num_tiles << " tiles ("
+            << tiled_stats.tile_nets_routed << " within a tile) after "
+            << "expanding " << tiled_stats.vertices_expanded << " vertices";
+  if (stats)
+    *stats = tiled_stats;
+  return num_routed;
+}
+
+size_t RoutingGrid::AddRoutesWithGlobalRouting(
+    const std::vector<RoutingNet> &nets,
+    const GlobalRoutingOptions &options,
+    std::vector<RoutingNetResult> *results,
+    GlobalRoutingStats *stats) {
+  GlobalRoutingStats global_stats;
+  results->assign(nets.size(), RoutingNetResult());
+  std::vector<size_t> order = OrderNets(nets, options.order);
+  if (tracks_by_layer_.empty()) {
+    LOG(ERROR) << "Cannot route without any tracks";
+    return 0;
+  }
+
+  // The GCells cover all of the routing layers' areas and are a whole number
+  // of tracks of the widest pitch across, so that every GCell has tracks
+  // through it.
+  Rectangle area;
+  int64_t pitch = 0;
+  bool first_layer = true;
+  for (const auto &entry : tracks_by_layer_) {
+    const RoutingLayerInfo &info = physical_db_.GetLayerInfo(entry.first);
+    pitch = std::max(pitch, info.pitch);
+    if (first_layer) {
+      area = info.area;
+      first_layer = false;
+      continue;
+    }
+    area = Rectangle(
+        Point(std::min(area.lower_left().x(), info.area.lower_left().x()),
+              std::min(area.lower_left().y(), info.area.lower_left().y())),
+        Point(std::max(area.upper_right().x(), info.area.upper_right().x()),
+              std::max(area.upper_right().y(), info.area.upper_right().y())));
+  }
+  int64_t gcell_size = static_cast<int64_t>(options.gcell_tracks) * pitch;
+  RoutingGCellGrid gcells(area, gcell_size, gcell_size);
+  for (const auto &entry : tracks_by_layer_) {
+    for (RoutingTrack *track : entry.second)
+      gcells.AddTrack(track->layer(), track->direction(), track->offset());
+  }
+  global_stats.num_gcells = gcells.num_gcells();
+
+  MaterialiseAroundNets(nets);
+
+  std::vector<RoutingGCellRoute> routes(nets.size());
+  for (size_t i : order) {
+    gcells.Route(nets[i].first->centre(), nets[i].second->centre(),
+                 options.overflow_cost, &routes[i]);
+  }
+  global_stats.overflowed_boundaries = gcells.NumOverflowed();
+  VLOG(1) << "Global routing over " << gcells.num_x() << " x "
+          << gcells.num_y() << " GCells overflowed "
+          << global_stats.overflowed_boundaries << " boundaries";
+
+  size_t num_routed = 0;
+  for (size_t i : order) {
+    const Port &begin = *nets[i].first;
+    const Port &end = *nets[i].second;
+    RoutingNetResult &result = (*results)[i];
+    CountNet(begin);
+
+    RoutingUndoLog undo_log;
+    RoutingVertex *begin_vertex = GenerateGridVertexForPoint(
+        begin.centre(), begin.layer(), &undo_log);
+    RoutingVertex *end_vertex = begin_vertex ? GenerateGridVertexForPoint(
+        end.centre(), end.layer(), &undo_log) : nullptr;
+    if (!begin_vertex || !end_vertex) {
+      LOG(ERROR) << "Could not find available vertices for net between "
+                 << begin.centre() << " and " << end.centre();
+      RollBack(&undo_log);
+      continue;
+    }
+
+    RoutingPath *path = nullptr;
+    // Ports outside the GCells get no corridor.
+    if (!routes[i].gcells.empty()) {
+      RoutingCorridor corridor(gcells);
+      corridor.Add(routes[i], options.corridor_margin);
+      RoutingSearchLimits limits;
+      limits.corridor = &corridor;
+      path = ShortestPath(begin_vertex, end_vertex, options.search, limits,
+                          &result.stats);
+      if (!path)
+        ++global_stats.corridor_failures;
+    }
+    if (!path && (routes[i].gcells.empty() ||
+                  options.fall_back_to_whole_grid)) {
+      path = ShortestPath(begin_vertex, end_vertex, options.search,
+                          RoutingSearchLimits(), &result.stats);
+    }
+    global_stats.vertices_expanded += result.stats.vertices_expanded;
+    if (!path) {
+      RollBack(&undo_log);
+      continue;
+    }
+
+    path->set_start_port(&begin);
+    path->set_end_port(&end);
+    InstallPath(path);
+    result.routed = true;
+    ++num_routed;
+  }
+  StopCountingNet();
+
+  LOG(INFO) << "Routed " << num_routed << " of " << nets.size()
+            << " nets in corridors over " << global_stats.num_gcells
+            << " GCells (" << global_stats.corridor_failures
+            << " did not fit) after expanding "
+            << global_stats.vertices_expanded << " vertices";
+  if (stats)
+    *stats = global_stats;
+  return num_routed;
+}
+
+bool RoutingGrid::RouteBetween(
+    const Port &begin, const Port &end, const RoutingSearchOptions &options,
+    RoutingSearchStats *stats) {
+  CountNet(begin);
+
+  // Whatever is made for the ends is taken out again if no path is found,
+  // so that a failed attempt leaves the grid as it was.
+  RoutingUndoLog undo_log;
   RoutingVertex *begin_vertex = GenerateGridVertexForPoint(
-      begin.centre(), begin.layer());
+      begin.centre(), begin.layer(), &undo_log);
   if (!begin_vertex) {
     LOG(ERROR) << "Could not find available vertex for begin port.";
+    StopCountingNet();
     return false;
   }
-  LOG(INFO) << "Nearest vertex to begin is " << begin_vertex->centre();
+  VLOG(1) << "Nearest vertex to begin is " << begin_vertex->centre();
 
   RoutingVertex *end_vertex = GenerateGridVertexForPoint(
-      end.centre(), end.layer());
+      end.centre(), end.layer(), &undo_log);
   if (!end_vertex) {
     LOG(ERROR) << "Could not find available vertex for end port.";
+    RollBack(&undo_log);
+    StopCountingNet();
     return false;
   }
-  LOG(INFO) << "Nearest vertex to end is " << end_vertex->centre();
-
-  std::unique_ptr<RoutingPath> shortest_path(
-      ShortestPath(begin_vertex, end_vertex));
-
+  VLOG(1) << "Nearest vertex to end is " << end_vertex->centre();
+
+  std::unique_ptr<RoutingPath> shortest_path;
+  if (options.try_patterns) {
+    // On a lazy grid the corners of the patterns have to exist first. The
+    // search would have made the same area anyway.
+    MaterialiseAround({begin.centre(), end.centre()}, LazyRegionSize());
+    std::deque<RoutingEdge*> edges;
+    if (FindPatternPath(begin_vertex, end_vertex, &edges)) {
+      shortest_path.reset(new RoutingPath(begin_vertex, edges));
+      // As in the search, vertices are only paid for where the path turns.
+      const std::vector<RoutingVertex*> vertices = shortest_path->vertices();
+      stats->path_cost = 0;
+      for (size_t i = 0; i < edges.size(); ++i) {
+        stats->path_cost += edges[i]->cost();
+        if (i > 0 && edges[i]->Direction() != edges[i - 1]->Direction())
+          stats->path_cost += vertices[i]->cost();
+      }
+      for (RoutingPhaseStats *phase : CountedPhases())
+        ++phase->pattern_routes;
+    }
+  }
+  if (!shortest_path) {
+    shortest_path.reset(
+        ShortestPath(begin_vertex, end_vertex, options, RoutingSearchLimits(),
+                     stats));
+  }
   if (!shortest_path) {
-    LOG(WARNING) << "No path found.";
+    RollBack(&undo_log);
+    StopCountingNet();
     return false;
   }
 
   // Remember the ports to which the path should connect.
   shortest_path->set_start_port(&begin);
-  shortest_path->set_end_port(&begin);
+  shortest_path->set_end_port(&end);
 
-  LOG(INFO) << "Found path: " << *shortest_path;
+  VLOG(1) << "Found path: " << *shortest_path;
 
   InstallPath(shortest_path.release());
+  StopCountingNet();
+  return true;
+}
+
+bool RoutingGrid::FindPatternPath(
+    RoutingVertex *begin, RoutingVertex *end,
+    std::deque<RoutingEdge*> *edges_out) const {
+  // An off-grid vertex hangs from the bridging vertex on a track by its only
+  // edge. The patterns start and stop on the tracks.
+  auto on_track = [](RoutingVertex *vertex, RoutingEdge **edge_out) {
+    *edge_out = nullptr;
+    if (vertex->horizontal_track() || vertex->vertical_track())
+      return vertex;
+    if (vertex->edges().size() != 1)
+      return static_cast<RoutingVertex*>(nullptr);
+    RoutingEdge *edge = vertex->edges().front();
+    RoutingVertex *other =
+        edge->first() == vertex ? edge->second() : edge->first();
+    if (!other->horizontal_track() && !other->vertical_track())
+      return static_cast<RoutingVertex*>(nullptr);
+    *edge_out = edge;
+    return other;
+  };
+  RoutingEdge *begin_edge;
+  RoutingEdge *end_edge;
+  RoutingVertex *from = on_track(begin, &begin_edge);
+  RoutingVertex *to = on_track(end, &end_edge);
+  if (!from || !to || from == to)
+    return false;
+
+  auto track_of = [](RoutingVertex *vertex,
+                     const RoutingTrackDirection &direction) {
+    return direction == RoutingTrackDirection::kTrackHorizontal ?
+        vertex->horizontal_track() : vertex->vertical_track();
+  };
+  auto other_direction = [](const RoutingTrackDirection &direction) {
+    return direction == RoutingTrackDirection::kTrackHorizontal ?
+        RoutingTrackDirection::kTrackVertical :
+        RoutingTrackDirection::kTrackHorizontal;
+  };
+  // Where a vertex is along a track in the given direction.
+  auto along = [](const RoutingTrackDirection &direction, const Point &point) {
+    return direction == RoutingTrackDirection::kTrackHorizontal ?
+        point.x() : point.y();
+  };
+  // The point on a track in the given direction through `on` that is level
+  // with `level`.
+  auto crossing = [](const RoutingTrackDirection &direction,
+                     const Point &on, const Point &level) {
+    return direction == RoutingTrackDirection::kTrackHorizontal ?
+        Point(level.x(), on.y()) : Point(on.x(), level.y());
+  };
+
+  std::vector<RoutingEdge*> edges;
+  auto straight = [&](const RoutingTrackDirection &direction) {
+    RoutingTrack *track = track_of(from, direction);
+    edges.clear();
+    return track && track == track_of(to, direction) &&
+        track->EdgesBetween(from, to, &edges);
+  };
+
+  // Along from's track in the given direction to the corner, then along to's
+  // track in the other.
+  auto l_shape = [&](const RoutingTrackDirection &direction) {
+    RoutingTrack *first = track_of(from, direction);
+    RoutingTrack *second = track_of(to, other_direction(direction));
+    if (!first || !second)
+      return false;
+    RoutingVertex *corner = first->VertexAt(
+        crossing(direction, from->centre(), to->centre()));
+    if (!corner || corner == from || corner == to ||
+        track_of(corner, other_direction(direction)) != second)
+      return false;
+    edges.clear();
+    return first->EdgesBetween(from, corner, &edges) &&
+        second->EdgesBetween(corner, to, &edges);
+  };
 
+  // Along from's track in the given direction, across on some track in the
+  // other, and along to's track in the first direction again. The crossing
+  // tracks are tried in order from from's end, and since the first leg is
+  // walked one edge at a time, the search for one stops where that leg is
+  // blocked.
+  auto z_shape = [&](const RoutingTrackDirection &direction) {
+    RoutingTrack *first = track_of(from, direction);
+    RoutingTrack *last = track_of(to, direction);
+    if (!first || !last || first == last)
+      return false;
+    RoutingTrackDirection across = other_direction(direction);
+    const std::map<int64_t, RoutingVertex*> &vertices =
+        first->vertices_by_position();
+    auto it = vertices.find(along(direction, from->centre()));
+    if (it == vertices.end())
+      return false;
+    int64_t target = along(direction, to->centre());
+    bool forward = target > it->first;
+
+    std::vector<RoutingEdge*> first_leg;
+    RoutingVertex *previous = from;
+    while (true) {
+      if (forward) {
+        ++it;
+        if (it == vertices.end() || it->first >= target)
+          break;
+      } else {
+        if (it == vertices.begin())
+          break;
+        --it;
+        if (it->first <= target)
+          break;
+      }
+      RoutingVertex *turn = it->second;
+      RoutingEdge *edge = first->FindEdgeBetween(previous, turn);
+      if (!edge)
+        break;
+      first_leg.push_back(edge);
+      previous = turn;
+
+      RoutingTrack *cross = track_of(turn, across);
+      if (!cross)
+        continue;
+      RoutingVertex *second_turn = last->VertexAt(
+          crossing(direction, to->centre(), turn->centre()));
+      if (!second_turn || second_turn == to ||
+          track_of(second_turn, across) != cross)
+        continue;
+      edges = first_leg;
+      if (cross->EdgesBetween(turn, second_turn, &edges) &&
+          last->EdgesBetween(second_turn, to, &edges))
+        return true;
+    }
+    return false;
+  };
+
+  const RoutingTrackDirection horizontal =
+      RoutingTrackDirection::kTrackHorizontal;
+  const RoutingTrackDirection vertical = RoutingTrackDirection::kTrackVertical;
+  bool found = straight(horizontal) || straight(vertical) ||
+      l_shape(horizontal) || l_shape(vertical) ||
+      z_shape(horizontal) || z_shape(vertical);
+  if (!found)
+    return false;
+
+  edges_out->clear();
+  if (begin_edge)
+    edges_out->push_back(begin_edge);
+  edges_out->insert(edges_out->end(), edges.begin(), edges.end());
+  if (end_edge)
+    edges_out->push_back(end_edge);
   return true;
 }
 
 bool RoutingGrid::RemoveVertex(RoutingVertex *vertex, bool and_delete) {
+  if (!graph_stale_) {
+    // Neighbours have to be found while the vertex is still on its tracks.
+    MarkNeighbourhoodDirty(vertex);
+    graph_.RemoveVertex(vertex);
+  }
+
+  // Off-grid edges we still own lead nowhere once the vertex is gone, so the
+  // vertex at the other end must forget them. (Those in a path belong to it
+  // and were disowned when it was installed.)
+  std::vector<RoutingEdge*> stranded_edges;
+  for (RoutingEdge *edge : vertex->edges()) {
+    if (off_grid_edges_.find(edge) != off_grid_edges_.end())
+      stranded_edges.push_back(edge);
+  }
+  for (RoutingEdge *edge : stranded_edges) {
+    RoutingVertex *other =
+        edge->first() == vertex ? edge->second() : edge->first();
+    other->RemoveEdge(edge);
+    vertex->RemoveEdge(edge);
+    // Vertices in installed paths have already left graph_.
+    if (!graph_stale_ && other->path_count() == 0)
+      graph_.MarkDirty(other);
+    off_grid_edges_.erase(edge);
+    edge_pool_.Delete(edge);
+  }
+
   if (vertex->horizontal_track())
     vertex->horizontal_track()->RemoveVertex(vertex);
   if (vertex->vertical_track())
@@ -749,152 +2394,529 @@ bool RoutingGrid::RemoveVertex(RoutingVertex *vertex, bool and_delete) {
     auto it = available_vertices_by_layer_.find(layer);
     if (it == available_vertices_by_layer_.end())
       continue;
-    auto &available_vertices = it->second;
-    auto pos = std::find(
-        available_vertices.begin(), available_vertices.end(), vertex);
-    LOG_IF(FATAL, pos == available_vertices.end())
+    LOG_IF(FATAL, !it->second.Remove(vertex))
         << "Did not find vertex we're removing in available ones for layer "
         << layer << "; vertex: " << vertex;
-    available_vertices.erase(pos);
   }
 
-  auto pos = std::find(vertices_.begin(), vertices_.end(), vertex);
-  LOG_IF(FATAL, pos == vertices_.end())
+  // Move the last vertex into the removed one's place.
+  size_t position = vertex->grid_position();
+  LOG_IF(FATAL, position >= vertices_.size() || vertices_[position] != vertex)
       << "Did not find vertex we're removing in RoutingGrid list of "
       << "vertices_: " << vertex;
-  vertices_.erase(pos);
+  vertices_[position] = vertices_.back();
+  vertices_[position]->set_grid_position(position);
+  vertices_.pop_back();
   if (and_delete)
-    delete vertex;
+    vertex_pool_.Delete(vertex);
   return true; // TODO(aryap): Always returning true, huh...
 }
 
 void RoutingGrid::InstallPath(RoutingPath *path) {
-  LOG_IF(FATAL, path->Empty()) << "Cannot install an empty path.";
-  // Remove edges from the track which owns them.
+  InstallPaths({path});
+}
+
+void RoutingGrid::InstallPaths(const std::vector<RoutingPath*> &paths) {
+  auto start = std::chrono::steady_clock::now();
+  size_t num_edges_used = 0;
+
+  // Remove edges from the track which owns them. This has to happen for all
+  // of them before any are marked as used, since consecutive edges along a
+  // track block each other. The edges on each track are then marked as used
+  // together.
+  std::vector<RoutingTrack*> tracks;
+  std::map<RoutingTrack*, std::vector<RoutingEdge*>> edges_by_track;
+  for (RoutingPath *path : paths) {
+    LOG_IF(FATAL, path->Empty()) << "Cannot install an empty path.";
+    num_edges_used += path->edges().size();
+    for (RoutingEdge *edge : path->edges()) {
+      RoutingTrack *track = edge->track();
+      if (track != nullptr) {
+        track->RemoveEdge(edge, false);
+        std::vector<RoutingEdge*> &track_edges = edges_by_track[track];
+        if (track_edges.empty())
+          tracks.push_back(track);
+        track_edges.push_back(edge);
+      } else {
+        // Off-grid edges are now owned by the path.
+        off_grid_edges_.erase(edge);
+      }
+    }
+  }
+
+  // The track's other edges that the path blocks are removed with it, and
+  // any of its blockages that the new spans touch are merged into them.
+  size_t num_edges_invalidated = 0;
+  size_t num_blockage_merges = 0;
   std::set<RoutingVertex*> unusable_vertices;
-  for (RoutingEdge *edge : path->edges()) {
-    if (edge->track() != nullptr)
-      edge->track()->MarkEdgeAsUsed(edge, &unusable_vertices);
+  for (RoutingTrack *track : tracks) {
+    const std::vector<RoutingEdge*> &track_edges = edges_by_track[track];
+    size_t num_edges = track->edges().size();
+    size_t num_blockages = track->num_blockages() + track_edges.size();
+    track->MarkEdgesAsUsed(track_edges, &unusable_vertices);
+    num_edges_invalidated += num_edges - track->edges().size();
+    num_blockage_merges += num_blockages - track->num_blockages();
   }
 
-  // Remove vertices from all of the tracks which reference them.
-  for (RoutingVertex *vertex : path->vertices()) {
-    unusable_vertices.erase(vertex);
-    RemoveVertex(vertex, false);
+  // Remove vertices from all of the tracks which reference them. Where paths
+  // branch off one another they share a vertex, which is only removed once.
+  std::set<RoutingVertex*> path_vertices;
+  for (RoutingPath *path : paths) {
+    for (RoutingVertex *vertex : path->vertices()) {
+      unusable_vertices.erase(vertex);
+      vertex->set_path_count(vertex->path_count() + 1);
+      if (path_vertices.insert(vertex).second)
+        RemoveVertex(vertex, false);
+    }
   }
 
   for (RoutingVertex *vertex : unusable_vertices) {
     RemoveVertex(vertex, true);
   }
-  
-  paths_.push_back(path);
-}
-
-RoutingPath *RoutingGrid::ShortestPath(
-    RoutingVertex *begin, RoutingVertex *end) {
-  // Give everything its index for the duration of this algorithm.
-  for (size_t i = 0; i < vertices_.size(); ++i) {
-    vertices_[i]->set_contextual_index(i);
-  }
 
-  std::vector<double> cost(vertices_.size());
+  paths_.insert(paths_.end(), paths.begin(), paths.end());
 
-  // Recording the edge to take back to the start that makes the shortest path,
-  // as well as the vertex it leads to. If RoutingEdge* is nullptr then this is
-  // invalid.
-  std::vector<std::pair<size_t, RoutingEdge*>> prev(vertices_.size());
-
-  // All vertices sorted according to their cost.
-  std::vector<RoutingVertex*> queue;
-
-  size_t begin_index = begin->contextual_index();
-  size_t end_index = end->contextual_index();
-
-  cost[begin_index] = 0;
+  double seconds = SecondsSince(start);
+  for (RoutingPhaseStats *phase : CountedPhases()) {
+    phase->paths_installed += paths.size();
+    phase->edges_used += num_edges_used;
+    phase->edges_invalidated += num_edges_invalidated;
+    phase->vertices_invalidated += unusable_vertices.size();
+    phase->blockage_merges += num_blockage_merges;
+    phase->install_seconds += seconds;
+  }
+}
 
-  for (size_t i = 0; i < vertices_.size(); ++i) {
-    RoutingVertex *vertex = vertices_[i];
-    LOG_IF(FATAL, i != vertex->contextual_index())
-      << "Vertex " << i << " no longer matches its index "
-      << vertex->contextual_index();
-    prev[i].second = nullptr;
-    if (i == begin_index)
+bool RoutingGrid::RemovePath(RoutingPath *path) {
+  auto it = std::find(paths_.begin(), paths_.end(), path);
+  if (it == paths_.end())
+    return false;
+  paths_.erase(it);
+  // Giving the path's tracks back joins what was either side of them.
+  components_valid_ = false;
+
+  // Give each track back the spans the path used on it, together, as when
+  // they were installed.
+  std::vector<RoutingTrack*> tracks;
+  std::map<RoutingTrack*, std::vector<RoutingEdge*>> edges_by_track;
+  for (RoutingEdge *edge : path->edges()) {
+    RoutingTrack *track = edge->track();
+    if (track == nullptr) {
+      // Off-grid edges were never taken off their vertices.
+      edge->first()->RemoveEdge(edge);
+      edge->second()->RemoveEdge(edge);
       continue;
-    cost[i] = std::numeric_limits<double>::max();
+    }
+    std::vector<RoutingEdge*> &track_edges = edges_by_track[track];
+    if (track_edges.empty())
+      tracks.push_back(track);
+    track_edges.push_back(edge);
+  }
+  std::set<RoutingVertex*> joined_vertices;
+  for (RoutingTrack *track : tracks) {
+    track->MarkEdgesAsUnused(edges_by_track[track], &joined_vertices);
+  }
+  // The tracks make new edges for the freed spans.
+  for (RoutingEdge *edge : path->edges()) {
+    edge_pool_.Delete(edge);
   }
 
-  queue.push_back(begin);
+  for (RoutingVertex *vertex : path->vertices()) {
+    vertex->set_path_count(vertex->path_count() - 1);
+    if (vertex->path_count() > 0)
+      continue;
+    // Off-grid and bridging vertices were only made for this path's ports.
+    // The tracks were joined across the bridging ones above.
+    RoutingTrack *horizontal = vertex->horizontal_track();
+    RoutingTrack *vertical = vertex->vertical_track();
+    if (vertex->bridging() || (!horizontal && !vertical)) {
+      vertex_pool_.Delete(vertex);
+      continue;
+    }
+    // Others go back on each of their tracks that has not since been blocked,
+    // or been given another vertex, where they were. One left on a single
+    // track still lets paths along it stop there.
+    if (horizontal && !horizontal->CanAddVertexAt(vertex->centre()))
+      horizontal = nullptr;
+    if (vertical && !vertical->CanAddVertexAt(vertex->centre()))
+      vertical = nullptr;
+    if (!horizontal && !vertical) {
+      vertex_pool_.Delete(vertex);
+      continue;
+    }
+    vertex->set_horizontal_track(horizontal);
+    vertex->set_vertical_track(vertical);
+    if (horizontal)
+      horizontal->AddVertex(vertex);
+    if (vertical)
+      vertical->AddVertex(vertex);
+    AddVertex(vertex);
+  }
 
-  while (!queue.empty()) {
-    // Have to resort the queue so that new cost changes take effect. (The
-    // queue is already mostly sorted so an insertion sort will be fast.)
-    std::sort(queue.begin(), queue.end(),
-              [&](RoutingVertex *a, RoutingVertex *b) {
-      // We want the lowest value at the back of the array.
-      return cost[a->contextual_index()] > cost[b->contextual_index()];
-    });
+  if (!graph_stale_) {
+    for (RoutingVertex *vertex : joined_vertices) {
+      graph_.MarkDirty(vertex);
+    }
+  }
+  delete path;
+  return true;
+}
 
-    RoutingVertex *current = queue.back();
-    queue.pop_back();
-    size_t current_index = current->contextual_index();
+double RoutingGrid::LowerBoundCostToEnd(
+    const Point &vertex,
+    const RoutingTrackDirection &arrival,
+    const Point &end) const {
+  uint64_t distance = std::abs(end.x() - vertex.x()) +
+                      std::abs(end.y() - vertex.y());
+  if (distance == 0)
+    return 0;
+  double bound = distance;
+  // The path has to turn at least once unless it can carry straight on to the
+  // end from here.
+  bool straight_on =
+      (arrival == RoutingTrackDirection::kTrackHorizontal &&
+       vertex.y() == end.y()) ||
+      (arrival == RoutingTrackDirection::kTrackVertical &&
+       vertex.x() == end.x());
+  if (!straight_on)
+    bound += min_vertex_cost_;
+  return bound;
+}
 
-    if (current == end) {
+RoutingPath *RoutingGrid::ShortestPath(
+    RoutingVertex *begin, RoutingVertex *end,
+    const RoutingSearchOptions &options,
+    const RoutingSearchLimits &limits,
+    RoutingSearchStats *stats) {
+  // The search is first held to a window around its ends, and only looks
+  // further if it fails there, so that the work for a short net does not grow
+  // with the grid. On a lazy grid the area around the ends is also all that
+  // is made at first. A search held to a window or corridor already cannot
+  // use anything outside it.
+  bool confined = limits.window != nullptr || limits.corridor != nullptr;
+  if (!MaybeConnected(begin, end)) {
+    for (RoutingPhaseStats *phase : CountedPhases())
+      ++phase->unreachable_rejections;
+    return nullptr;
+  }
+  bool windowed = !confined && options.window_margin_tracks > 0;
+  int64_t margin = windowed ?
+      static_cast<int64_t>(options.window_margin_tracks) * MaxPitch() :
+      LazyRegionSize();
+  const Point &begin_centre = begin->centre();
+  const Point &end_centre = end->centre();
+  RoutingSearchLimits window_limits = limits;
+  RoutingPath *path = nullptr;
+  size_t num_attempts = 0;
+  while (true) {
+    MaterialiseAround({begin_centre, end_centre}, margin);
+    Rectangle window(
+        Point(std::min(begin_centre.x(), end_centre.x()) - margin,
+              std::min(begin_centre.y(), end_centre.y()) - margin),
+        Point(std::max(begin_centre.x(), end_centre.x()) + margin,
+              std::max(begin_centre.y(), end_centre.y()) + margin));
+    if (windowed)
+      window_limits.window = &window;
+
+    std::vector<size_t> slots;
+    // This also gives every vertex its index.
+    RefreshGraph();
+    RoutingSearchStats search_stats;
+    bool found = FindShortestPath({begin}, end, options, window_limits,
+                                  &workspace_, &search_stats, &slots);
+    ++num_attempts;
+    CountSearch(search_stats);
+    AddSearchCounters(search_stats, stats);
+    if (found && !slots.empty()) {
+      stats->path_cost = search_stats.path_cost;
+      path = PathFromSlots(begin, slots);
       break;
     }
+    if (confined)
+      break;
+    // If the window kept the search from nothing, and there is nothing left
+    // to make, a wider one would not help. Unless taken resources were
+    // avoided, the search has then been everywhere it could reach from begin
+    // without finding end, so their labels should differ.
+    if (search_stats.window_rejections == 0 && FullyMaterialised()) {
+      if (!found && limits.taken == nullptr &&
+          begin->component() == end->component())
+        SplitComponent(begin);
+      break;
+    }
+    margin = std::max(2 * margin, static_cast<int64_t>(1));
+  }
 
-    for (RoutingEdge *edge : current->edges()) {
-      // We don't know what direction we're using the edge in, and edges are
-      // not directional per se, so pick the side that isn't the one we came in
-      // on:
-      // TODO(aryap): Maybe bake this into the RoutingEdge.
-      RoutingVertex *next =
-          edge->first() == current ? edge->second() : edge->first();
+  if (windowed) {
+    stats->window_attempts += num_attempts;
+    stats->window_margin = std::max(stats->window_margin, margin);
+    for (RoutingPhaseStats *phase : CountedPhases()) {
+      phase->window_attempts += num_attempts;
+      if (num_attempts > 1)
+        ++phase->windows_widened;
+      phase->widest_window_margin =
+          std::max(phase->widest_window_margin, margin);
+    }
+  }
+  return path;
+}
 
-      size_t next_index = next->contextual_index();
-      double next_cost = cost[current_index] + edge->cost() + next->cost();
+RoutingPath *RoutingGrid::PathFromSlots(
+    RoutingVertex *begin, const std::vector<size_t> &slots) const {
+  std::deque<RoutingEdge*> edges;
+  RoutingVertex *last_vertex = begin;
+  for (size_t slot : slots) {
+    RoutingEdge *edge = graph_.edge(slot);
+    LOG_IF(FATAL, edge->first() != last_vertex && edge->second() != last_vertex)
+        << "Edge does not continue path from " << last_vertex->centre();
+    last_vertex = graph_.vertex(graph_.target(slot));
+    edges.push_back(edge);
+  }
+  return new RoutingPath(begin, edges);
+}
 
-      if (next_cost < cost[next_index]) {
-        cost[next_index] = next_cost;
-        prev[next_index] = std::make_pair(current_index, edge);
+RoutingPath *RoutingGrid::RebuildPath(
+    const std::vector<RoutingVertex*> &vertices,
+    const std::vector<size_t> &indices,
+    const std::vector<size_t> &slots) const {
+  std::deque<RoutingEdge*> edges;
+  // Take each straight run in turn. Slot i leads from vertex i to vertex
+  // i + 1.
+  size_t first = 0;
+  while (first < slots.size()) {
+    RoutingTrackDirection direction = graph_.edge_direction(slots[first]);
+    size_t last = first;
+    while (last + 1 < slots.size() &&
+           graph_.edge_direction(slots[last + 1]) == direction) {
+      ++last;
+    }
+    // The path turns (or ends) at either end of the run, so those vertices
+    // must still be there.
+    if (!graph_.live(indices[first]) || !graph_.live(indices[last + 1]))
+      return nullptr;
+
+    RoutingVertex *start = vertices[first];
+    RoutingTrack *track =
+        direction == RoutingTrackDirection::kTrackHorizontal ?
+        start->horizontal_track() : start->vertical_track();
+    if (track == nullptr) {
+      // Off-grid edges are only ever removed with their vertices.
+      for (size_t i = first; i <= last; ++i) {
+        if (!graph_.live(indices[i + 1]))
+          return nullptr;
+        edges.push_back(graph_.edge(slots[i]));
+      }
+    } else {
+      // Vertices in the middle of the run may have been taken by paths
+      // crossing this one on the other track, in which case this track joins
+      // the vertices either side instead.
+      RoutingVertex *previous = start;
+      for (size_t i = first + 1; i <= last + 1; ++i) {
+        if (!graph_.live(indices[i]))
+          continue;
+        RoutingEdge *edge = track->FindEdgeBetween(previous, vertices[i]);
+        if (!edge)
+          return nullptr;
+        edges.push_back(edge);
+        previous = vertices[i];
+      }
+    }
+    first = last + 1;
+  }
+  return new RoutingPath(vertices.front(), edges);
+}
 
-        // Since we now have a faster way to get to this edge, we should visit it.
-        queue.push_back(next);
+bool RoutingGrid::EdgesThrough(
+    const std::vector<RoutingVertex*> &vertices,
+    std::vector<RoutingEdge*> *edges_out) const {
+  for (size_t i = 0; i + 1 < vertices.size(); ++i) {
+    RoutingVertex *from = vertices[i];
+    RoutingVertex *to = vertices[i + 1];
+    RoutingTrack *track = nullptr;
+    if (from->horizontal_track() &&
+        from->horizontal_track() == to->horizontal_track()) {
+      track = from->horizontal_track();
+    } else if (from->vertical_track() &&
+               from->vertical_track() == to->vertical_track()) {
+      track = from->vertical_track();
+    }
+    if (track) {
+      if (!track->EdgesBetween(from, to, edges_out))
+        return false;
+      continue;
+    }
+    RoutingEdge *off_grid = nullptr;
+    for (RoutingEdge *edge : from->edges()) {
+      if (edge->track() == nullptr &&
+          (edge->first() == to || edge->second() == to)) {
+        off_grid = edge;
+        break;
       }
     }
+    if (!off_grid)
+      return false;
+    edges_out->push_back(off_grid);
   }
+  return true;
+}
 
-  std::deque<RoutingEdge*> shortest_edges;
+double RoutingGrid::PathCost(
+    size_t begin_index, const std::vector<size_t> &slots) const {
+  double cost = 0;
+  size_t index = begin_index;
+  for (size_t i = 0; i < slots.size(); ++i) {
+    cost += graph_.edge_cost(slots[i]);
+    if (i > 0 &&
+        graph_.edge_direction(slots[i]) != graph_.edge_direction(slots[i - 1]))
+      cost += graph_.vertex_cost(index);
+    index = graph_.target(slots[i]);
+  }
+  return cost;
+}
 
-  size_t last_index = prev[end_index].first;
-  RoutingEdge *last_edge = prev[end_index].second;
+bool RoutingGrid::FindShortestPath(
+    const std::vector<RoutingVertex*> &begins, RoutingVertex *end,
+    const RoutingSearchOptions &options,
+    const RoutingSearchLimits &limits,
+    RoutingSearchWorkspace *workspace,
+    RoutingSearchStats *stats,
+    std::vector<size_t> *slots_out,
+    RoutingVertex **begin_out) const {
+  auto start = std::chrono::steady_clock::now();
+
+  // A vertex only costs something (a via) if the path turns there, so the
+  // cost of continuing from a vertex depends on the direction we arrived in.
+  // We search over (vertex, arrival direction) states instead of vertices;
+  // the state for vertex i arriving in direction d has index 2 * i + d.
+  auto state_index = [](size_t vertex_index,
+                        const RoutingTrackDirection &direction) {
+    return 2 * vertex_index + static_cast<size_t>(direction);
+  };
+  auto state_direction = [](size_t state) {
+    return static_cast<RoutingTrackDirection>(state % 2);
+  };
+  size_t num_states = 2 * graph_.size();
 
-  while (last_edge != nullptr) {
-    LOG_IF(FATAL, (last_edge->first() != vertices_[last_index] &&
-                   last_edge->second() != vertices_[last_index]))
-        << "last_edge does not land back at source vertex";
+  // For each state, the workspace records the best known cost and the slot of
+  // the edge to take back towards the start (as well as the state it leads
+  // to). The beginning states have no previous slot.
+  workspace->Begin(num_states, options.queue_type);
 
-    shortest_edges.push_front(last_edge);
+  // States yet to be visited, ordered by their cost.
+  RoutingPriorityQueue *queue = workspace->queue();
 
-    if (last_index == begin_index) {
-      // We found our way back.
-      break;
+  size_t end_index = end->contextual_index();
+  const Point &end_centre = graph_.centre(end_index);
+
+  // With A*, states are ordered by their cost plus a lower bound on the
+  // remaining cost to the end. Since the bound is consistent (it never drops
+  // by more than the cost of the edge taken), the first time we pop the end
+  // vertex we have the shortest path.
+  //
+  // Many states can share the same total estimate (e.g. every corner of every
+  // L-shaped path between the two ends), so among those we prefer the ones
+  // estimated to be closest to the end.
+  auto push = [&](size_t state) {
+    double cost = workspace->cost(state);
+    if (!options.use_a_star) {
+      queue->Push(state, cost);
+    } else {
+      double remaining = LowerBoundCostToEnd(
+          graph_.centre(state / 2), state_direction(state), end_centre);
+      queue->Push(state, cost + remaining, remaining);
     }
+    ++stats->queue_pushes;
+  };
 
-    auto &last_entry = prev[last_index];
-    last_index = last_entry.first;
-    last_edge = last_entry.second;
+  // We can leave any of the beginnings in either direction without turning.
+  for (RoutingVertex *begin : begins) {
+    for (const RoutingTrackDirection &direction : {
+            RoutingTrackDirection::kTrackHorizontal,
+            RoutingTrackDirection::kTrackVertical}) {
+      size_t begin_state = state_index(begin->contextual_index(), direction);
+      workspace->Set(begin_state, 0,
+                     RoutingSearchWorkspace::kNone,
+                     RoutingSearchWorkspace::kNone);
+      push(begin_state);
+    }
   }
 
-  if (shortest_edges.empty()) {
-    return nullptr;
-  } else if (shortest_edges.front()->first() != begin &&
-             shortest_edges.front()->second() != begin) {
-    LOG(FATAL) << "Did not find beginning vertex.";
-    return nullptr;
+  bool found = false;
+  size_t end_state = 0;
+  while (!queue->Empty()) {
+    size_t current_state = queue->Pop();
+    size_t current_index = current_state / 2;
+
+    if (current_index == end_index) {
+      found = true;
+      end_state = current_state;
+      break;
+    }
+    ++stats->vertices_expanded;
+
+    double current_cost = workspace->cost(current_state);
+    for (size_t slot = graph_.Begin(current_index);
+         slot < graph_.End(current_index);
+         ++slot) {
+      RoutingTrackDirection direction = graph_.edge_direction(slot);
+      size_t next_state = state_index(graph_.target(slot), direction);
+      double edge_cost = graph_.edge_cost(slot);
+      size_t next_index = graph_.target(slot);
+      size_t resource = state_index(current_index, direction);
+      if (limits.window &&
+          !limits.window->Contains(graph_.centre(next_index))) {
+        ++stats->window_rejections;
+        continue;
+      }
+      if (limits.corridor && next_index != end_index &&
+          !limits.corridor->Contains(graph_.centre(next_index)))
+        continue;
+      // Taken resources can still be used at the ends of the search.
+      if (limits.taken &&
+          (((*limits.taken)[resource] &&
+            workspace->prev_slot(current_state) !=
+                RoutingSearchWorkspace::kNone) ||
+           ((*limits.taken)[next_state] && next_index != end_index))) {
+        continue;
+      }
+      if (limits.congestion) {
+        edge_cost = limits.congestion->ScaledCost(
+            resource, next_state, edge_cost);
+      }
+      double next_cost = current_cost + edge_cost;
+      if (direction != state_direction(current_state))
+        next_cost += graph_.vertex_cost(current_index);
+
+      if (next_cost < workspace->cost(next_state)) {
+        workspace->Set(next_state, next_cost, current_state, slot);
+
+        // Since we now have a faster way to get to this state, we should
+        // visit it. If it is already queued this just decreases its cost.
+        push(next_state);
+      }
+    }
   }
+  stats->stale_pops += queue->stale_pops();
+  stats->seconds += SecondsSince(start);
 
-  RoutingPath *path = new RoutingPath(begin, shortest_edges);
-  return path;
+  if (!found)
+    return false;
+
+  slots_out->clear();
+  size_t last_state = end_state;
+  while (workspace->prev_slot(last_state) != RoutingSearchWorkspace::kNone) {
+    slots_out->push_back(workspace->prev_slot(last_state));
+    last_state = workspace->prev_state(last_state);
+  }
+  RoutingVertex *begin = graph_.vertex(last_state / 2);
+  LOG_IF(FATAL, std::find(begins.begin(), begins.end(), begin) == begins.end())
+      << "Did not find beginning vertex.";
+  std::reverse(slots_out->begin(), slots_out->end());
+  if (begin_out)
+    *begin_out = begin;
+
+  stats->path_cost = workspace->cost(end_state);
+  return true;
 }
 
 void RoutingGrid::AddTrackToLayer(RoutingTrack *track, const Layer &layer) {
@@ -8,10 +8,21 @@
 #include "poly_line_cell.h"
 #include "port.h"
 #include "rectangle.h"
-
+#include "routing_congestion.h"
+#include "routing_gcell_grid.h"
+#include "routing_graph_view.h"
+#include "routing_object_pool.h"
+#include "routing_priority_queue.h"
+#include "routing_search_workspace.h"
+#include "routing_track_occupancy.h"
+#include "routing_vertex_index.h"
+
+#include <limits>
 #include <map>
 #include <set>
 #include <deque>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace boralago {
@@ -22,33 +33,59 @@ class RoutingTrack;
 class RoutingVertex {
  public:
   RoutingVertex(const Point &centre)
-      : available_(true), horizontal_track_(nullptr), vertical_track_(nullptr),
-        centre_(centre) {}
+      : available_(true), bridging_(false), horizontal_track_(nullptr),
+        vertical_track_(nullptr), path_count_(0), component_(0),
+        centre_(centre), cost_(1.0) {}
 
-  void AddEdge(RoutingEdge *edge) { edges_.insert(edge); }
+  void AddEdge(RoutingEdge *edge);
   bool RemoveEdge(RoutingEdge *edge);
 
   //const std::set<RoutingEdge*> &edges() { return edges_; }
 
-  uint64_t L1DistanceTo(const Point &point);
+  uint64_t L1DistanceTo(const Point &point) const;
 
-  // This is the cost of connecting through this vertex (i.e. a via).
-  double cost() const { return 1.0; }
+  // This is the cost of connecting through this vertex (i.e. a via). It is
+  // only paid by paths that change direction, and so layer, here.
+  void set_cost(double cost) { cost_ = cost; }
+  double cost() const { return cost_; }
 
   void AddConnectedLayer(const Layer &layer) {
     connected_layers_.push_back(layer);
   }
-  const std::vector<Layer> &connected_layers() { return connected_layers_; }
+  const std::vector<Layer> &connected_layers() const {
+    return connected_layers_;
+  }
 
   void set_contextual_index(size_t index) { contextual_index_ = index; }
   size_t contextual_index() const { return contextual_index_; }
 
-  const std::set<RoutingEdge*> edges() const { return edges_; }
+  // Where the vertex is in the owning RoutingGrid's list of vertices, so that
+  // it can be removed from there without searching.
+  void set_grid_position(size_t position) { grid_position_ = position; }
+  size_t grid_position() const { return grid_position_; }
+
+  const std::vector<RoutingEdge*> &edges() const { return edges_; }
 
   const Point &centre() const { return centre_; }
 
   void set_available(bool available) { available_ = available; }
-  bool available() { return available_; }
+  bool available() const { return available_; }
+
+  // Whether this vertex was made on a track only to reach a port (see
+  // RoutingGrid::GenerateGridVertexForPoint), and so is taken out again once
+  // no path uses it.
+  void set_bridging(bool bridging) { bridging_ = bridging; }
+  bool bridging() const { return bridging_; }
+
+  // The number of installed paths through this vertex. This is only ever
+  // more than one where paths on the same net branch off one another.
+  void set_path_count(size_t count) { path_count_ = count; }
+  size_t path_count() const { return path_count_; }
+
+  // The label of the connected component of the grid this is in, as kept by
+  // the RoutingGrid.
+  void set_component(size_t component) { component_ = component; }
+  size_t component() const { return component_; }
 
   void set_horizontal_track(RoutingTrack *track) { horizontal_track_ = track; }
   RoutingTrack *horizontal_track() const { return horizontal_track_; }
@@ -57,6 +94,7 @@ class RoutingVertex {
 
  private:
   bool available_;
+  bool bridging_;
   RoutingTrack *horizontal_track_;
   RoutingTrack *vertical_track_;
 
@@ -65,9 +103,15 @@ class RoutingVertex {
   // RoutingVertex for the duration of whatever process requires it.
   size_t contextual_index_;
 
+  size_t grid_position_;
+  size_t path_count_;
+  size_t component_;
+
   Point centre_;
+  double cost_;
   std::vector<Layer> connected_layers_;
-  std::set<RoutingEdge*> edges_;
+  // A vertex only has a few edges, so these are kept in a plain list.
+  std::vector<RoutingEdge*> edges_;
 };
 
 // Edges are NOT directed.
@@ -94,7 +138,11 @@ class RoutingEdge {
 
   const Layer &ExplicitOrTrackLayer() const;
 
-  // Off-grid edges do not have tracks.
+  // Whether the edge runs horizontally or vertically.
+  RoutingTrackDirection Direction() const;
+
+  // Off-grid edges do not have tracks. Edges used by a path remember the
+  // track they were on, so that they can be given back to it.
   void set_track(RoutingTrack *track);
   RoutingTrack *track() const { return track_; }
 
@@ -109,29 +157,17 @@ class RoutingEdge {
   RoutingVertex *first_;
   RoutingVertex *second_;
 
-  // Need some function of the distance between the two vertices (like of
-  // length, sheet resistance). This also needs to be computed only once...
+  // Whoever creates the edge sets this to its length, so that the Manhattan
+  // distance is a lower bound on path cost. TODO(aryap): Include some function
+  // of the layer, like sheet resistance.
   double cost_;
 };
 
 class RoutingPath {
  public:
-  // We seize ownership of the edges and vertices given to this path.
-  //
-  // TODO(aryap): Maybe we should just leave ownership up to the RoutingGrid
-  // and just make sure all the referenced edges and vertices in paths are
-  // ultimately deleted anyway.
-  //
-  // TODO(aryap): Yeah, this makes me nervous. In order to avoid simply keeping
-  // all routing resources, something you'd call a premature optimisation, I
-  // now have to make sure that ownership of used edges is transferred from
-  // wherever into the paths. This better not bite me in the ass like it
-  // absolutely is going to.
+  // The edges and vertices given to this path stay owned by the RoutingGrid,
+  // which keeps them until it is destroyed once the path is installed.
   RoutingPath(RoutingVertex *start, const std::deque<RoutingEdge*> edges);
-  ~RoutingPath() {
-    for (RoutingVertex *vertex : vertices_) { delete vertex; }
-    for (RoutingEdge *edge : edges_) { delete edge; }
-  }
 
   RoutingVertex *Begin() const {
     return Empty() ? nullptr : vertices_.front();
@@ -163,11 +199,9 @@ class RoutingPath {
 
   // The ordered list of vertices making up the path. The edges alone, since
   // they are undirected, do not yield this directional information.
-  // These vertices are OWNED by RoutingPath.
   std::vector<RoutingVertex*> vertices_;
 
   // The list of edges. Edge i connected vertices_[j] and vertices_[j+1].
-  // These edges are OWNED by RoutingPath.
   std::vector<RoutingEdge*> edges_;
 };
 
@@ -181,11 +215,11 @@ class RoutingTrackBlockage {
         << "RoutingTrackBlockage start must be before end.";
   }
 
-  bool Contains(int64_t position);
-  bool IsAfter(int64_t position);
-  bool IsBefore(int64_t position);
+  bool Contains(int64_t position) const;
+  bool IsAfter(int64_t position) const;
+  bool IsBefore(int64_t position) const;
 
-  bool Blocks(int64_t low, int64_t high);
+  bool Blocks(int64_t low, int64_t high) const;
 
   void set_start(int64_t start) { start_ = start; }
   void set_end(int64_t end) { end_ = end; }
@@ -207,15 +241,17 @@ class RoutingTrackBlockage {
 // up.
 class RoutingTrack {
  public:
+  // New vertices and edges are made in, and deleted from, the given pools.
   RoutingTrack(const Layer &layer,
                const RoutingTrackDirection &direction,
-               int64_t offset)
-      : layer_(layer), direction_(direction), offset_(offset) {}
-
-  ~RoutingTrack() {
-    for (RoutingEdge *edge : edges_) { delete edge; }
-    for (RoutingTrackBlockage *blockage : blockages_) { delete blockage; }
-  }
+               int64_t offset,
+               RoutingObjectPool<RoutingVertex> *vertex_pool,
+               RoutingObjectPool<RoutingEdge> *edge_pool)
+      : layer_(layer),
+        direction_(direction),
+        offset_(offset),
+        vertex_pool_(vertex_pool),
+        edge_pool_(edge_pool) {}
 
   // Tries to add an edge between the two vertices, returning true if
   // successful and false if no edge could be added (it was blocked).
@@ -224,21 +260,44 @@ class RoutingTrack {
   bool RemoveEdge(RoutingEdge *edge, bool and_delete);
 
   // Adds the given vertex to this track, but does not take ownership of it.
-  // Generates an edge from the given vertex to every other vertex in the
-  // track, as long as that edge would not be blocked already.
+  // Generates an edge from the given vertex to its nearest neighbour on either
+  // side, as long as that edge would not be blocked already. An existing edge
+  // between those neighbours is split in two.
+  //
+  // Only neighbouring vertices are ever connected, so a track with n vertices
+  // has at most n - 1 edges. Longer runs are chains of these edges.
   bool AddVertex(RoutingVertex *vertex);
 
-  // Remove the vertex from this track, and remove any edge that uses it.
+  // Remove the vertex from this track, and remove any edge that uses it. The
+  // neighbours either side are reconnected if the span between them is not
+  // blocked.
   bool RemoveVertex(RoutingVertex *vertex);
 
-  // 
+  // Blocks the span of the given edge, which must be (or have been) on this
+  // track, and removes every edge and vertex it makes unusable. Blocked
+  // vertices are added to removed_vertices for the caller to dispose of.
   void MarkEdgeAsUsed(RoutingEdge *edge,
                       std::set<RoutingVertex*> *removed_vertices);
 
+  // As MarkEdgeAsUsed, for many edges at once. The blockages are all added
+  // together and the track's edges and vertices are checked against them
+  // once.
+  void MarkEdgesAsUsed(const std::vector<RoutingEdge*> &edges,
+                       std::set<RoutingVertex*> *removed_vertices);
+
+  // Undoes MarkEdgesAsUsed for the given edges: their spans are unblocked,
+  // and neighbouring vertices on the track either side of and within each
+  // span are joined again where nothing else blocks them. Vertices that gain
+  // an edge are added to joined_vertices. Vertices removed when the edges
+  // were used are not put back.
+  void MarkEdgesAsUnused(const std::vector<RoutingEdge*> &edges,
+                         std::set<RoutingVertex*> *joined_vertices);
+
   // Triest to connect the target vertex to a canidate vertex placed at the
   // nearest point on the track to the given point. If successful, the new
-  // vertex is returned, otherwise nullptr. The return vertex is property of
-  // the caller and any generated edge is property of the track.
+  // vertex is returned, otherwise nullptr. The return vertex is made in the
+  // vertex pool for the caller to add to the grid, and any generated edge is
+  // property of the track.
   RoutingVertex *CreateNearestVertexAndConnect(
       const Point &point,
       RoutingVertex *target);
@@ -246,11 +305,56 @@ class RoutingTrack {
   void ReportAvailableEdges(std::vector<RoutingEdge*> *edges_out);
   void ReportAvailableVertices(std::vector<RoutingVertex*> *vertices_out);
 
+  // Appends the vertices either side of the given one on this track, if any.
+  void ReportNeighbours(RoutingVertex *vertex,
+                        std::vector<RoutingVertex*> *neighbours_out) const;
+
+  // Returns the edge on this track between the two vertices, if any.
+  RoutingEdge *FindEdgeBetween(
+      RoutingVertex *one, RoutingVertex *the_other) const;
+
   std::string Debug() const;
 
+  // Whether a new vertex could go at the point: it is not blocked and there
+  // is not one there already.
+  bool CanAddVertexAt(const Point &point) const;
+
+  // Returns the vertex on this track at the point, if there is one.
+  RoutingVertex *VertexAt(const Point &point) const;
+
+  // Appends the edges along this track from one of its vertices to another,
+  // in order, to edges_out. Returns false, leaving edges_out alone, if the
+  // track is blocked between them or any neighbours between them are not
+  // joined.
+  bool EdgesBetween(RoutingVertex *from, RoutingVertex *to,
+                    std::vector<RoutingEdge*> *edges_out) const;
+
   const std::set<RoutingEdge*> &edges() const { return edges_; }
+  const std::map<int64_t, RoutingVertex*> &vertices_by_position() const {
+    return vertices_by_position_;
+  }
+  const std::multiset<std::pair<int64_t, int64_t>> &blocked_spans() const {
+    return blocked_spans_;
+  }
+  // The number of blockages once overlapping spans are merged.
+  size_t num_blockages() const { return blockages_.size(); }
+
+  // Vertices are usually made every pitch along the track from start. Spans
+  // blocked are then also kept as bits at those positions, so that most
+  // questions about whether a span is blocked need not search the blockages.
+  void SetPitch(int64_t start, int64_t pitch);
+  const RoutingTrackOccupancy &occupancy() const { return occupancy_; }
+
+  // Puts back what a snapshot recorded of the track: the vertices on it, its
+  // edges, and the spans blocked. Nothing is checked or invalidated, and the
+  // edges must already be on their vertices.
+  void Restore(const std::vector<RoutingVertex*> &vertices,
+               const std::vector<RoutingEdge*> &edges,
+               const std::vector<std::pair<int64_t, int64_t>> &blocked_spans);
 
   const Layer &layer() const { return layer_; }
+  const RoutingTrackDirection &direction() const { return direction_; }
+  int64_t offset() const { return offset_; }
 
  private:
   bool IsBlocked(const Point &point) const {
@@ -260,16 +364,28 @@ class RoutingTrack {
 
   int64_t ProjectOntoTrack(const Point &point) const;
 
-  RoutingTrackBlockage *CreateBlockage(const Point &one_end, const Point &other_end);
+  // Removes the edges blocked by a new blockage over [low, high], and adds the
+  // vertices it blocks to removed_vertices.
+  void InvalidateSpan(int64_t low, int64_t high,
+                      std::set<RoutingVertex*> *removed_vertices);
 
-  void SortBlockages();
+  // Blocks [low, high], merging with any blockages it touches.
+  void AddBlockage(int64_t low, int64_t high);
 
-  // The edges generated for vertices on this track. These are OWNED by
-  // RoutingTrack.
+  // Blocks all of the given [low, high] spans.
+  void AddBlockages(std::vector<std::pair<int64_t, int64_t>> spans);
+
+  // Unblocks spans given to AddBlockages before. Only the blockages they were
+  // merged into are rebuilt.
+  void RemoveBlockages(const std::vector<std::pair<int64_t, int64_t>> &spans);
+
+  // The edges generated for vertices on this track. They are made in, and
+  // deleted from, edge_pool_.
   std::set<RoutingEdge*> edges_;
 
-  // The vertices on this track. Vertices are NOT OWNED by RoutingTrack.
-  std::set<RoutingVertex*> vertices_;
+  // The vertices on this track, keyed by their position along it. Vertices
+  // are NOT OWNED by RoutingTrack.
+  std::map<int64_t, RoutingVertex*> vertices_by_position_;
 
   Layer layer_;
   RoutingTrackDirection direction_;
@@ -277,18 +393,276 @@ class RoutingTrack {
   // The x or y coordinate for this track.
   int64_t offset_;
 
-  // We want to keep a sorted list of blockages, but if we keep them as a std::set
-  // we can't mutate the objects (since then no resorting is performed).
-  // Instead we keep a vector and make sure to sort it ourselves.
-  std::vector<RoutingTrackBlockage*> blockages_;
+  // Blockages are kept sorted, and any that overlap or touch are merged, so
+  // that both their starts and ends are in ascending order and the one that
+  // might overlap a span can be found by binary search.
+  std::vector<RoutingTrackBlockage> blockages_;
+
+  // Every span blocked, before merging, so that blockages can be rebuilt
+  // when one is removed.
+  std::multiset<std::pair<int64_t, int64_t>> blocked_spans_;
+
+  // The blockages again, as bits.
+  RoutingTrackOccupancy occupancy_;
+
+  // These belong to the RoutingGrid.
+  RoutingObjectPool<RoutingVertex> *vertex_pool_;
+  RoutingObjectPool<RoutingEdge> *edge_pool_;
 };
 
 std::ostream &operator<<(std::ostream &os, const RoutingTrack &track);
 
+// Per-call knobs for the shortest-path search.
+struct RoutingSearchOptions {
+  RoutingQueueType queue_type = RoutingQueueType::kQueueBinaryHeap;
+
+  // Guide the search towards the end vertex with an admissible estimate of the
+  // remaining cost (A*). Found paths cost the same as without it.
+  bool use_a_star = false;
+
+  // Try the simplest shapes between the ends first, by looking along their
+  // tracks: a straight run, then one bend (L), then two (Z). The first that
+  // fits is used without searching. It is not compared with what a search
+  // would find, and charges each turn the cost of the vertex there, so it can
+  // cost more; this is off unless asked for. Only routes between two ports
+  // over the whole grid use this.
+  bool try_patterns = false;
+
+  // Searches not otherwise confined are first held to the bounding box of
+  // their ends grown by this many tracks (of the widest pitch) on every side.
+  // If no path is found, and the window kept the search from going anywhere,
+  // the margin is doubled and the search tried again. A path found in a
+  // window can cost more than one leaving it would, so this is off (0,
+  // searching everywhere at once) unless asked for. 8 is a good start.
+  size_t window_margin_tracks = 0;
+};
+
+// Counters describing the work done by one shortest-path search.
+struct RoutingSearchStats {
+  // Vertices popped from the queue and whose edges were explored. A vertex
+  // can be expanded once for each direction it is reached in.
+  size_t vertices_expanded = 0;
+  size_t queue_pushes = 0;
+  // Outdated queue entries popped and thrown away (see
+  // RoutingPriorityQueue::stale_pops).
+  size_t stale_pops = 0;
+  // Edges not followed because they leave the search window.
+  size_t window_rejections = 0;
+  // The windows tried, and the widest margin of any of them (0 if the search
+  // was not held to one).
+  size_t window_attempts = 0;
+  int64_t window_margin = 0;
+  // Wall time spent searching.
+  double seconds = 0;
+  // The cost of the path found, if any.
+  double path_cost = 0;
+};
+
+// Limits on where a search may go, beyond what the grid allows. Resources are
+// the tracks through each vertex, as in RoutingCongestion.
+struct RoutingSearchLimits {
+  // Only vertices whose centres are inside the window are visited.
+  const Rectangle *window = nullptr;
+  // Only vertices inside the corridor are visited, apart from the end.
+  const RoutingCorridor *corridor = nullptr;
+  // Resources already taken (non-zero), which can only be used at the ends of
+  // the search.
+  const std::vector<uint8_t> *taken = nullptr;
+  // Scales edge costs while negotiating.
+  const RoutingCongestion *congestion = nullptr;
+};
+
+// The order in which AddRoutesBetween routes the nets it is given. Earlier nets
+// get first pick of the grid.
+enum RoutingNetOrder {
+  // As given.
+  kNetOrderGiven,
+  // Smallest bounding box (half-perimeter) first, since short nets have the
+  // fewest ways around obstacles.
+  kNetOrderBoundingBox,
+  // Nets whose net name has the most pairs first, then by bounding box.
+  kNetOrderFanOut
+};
+
+// A two-pin net: a pair of ports to connect.
+typedef std::pair<const Port*, const Port*> RoutingNet;
+
+struct RoutingNetResult {
+  bool routed = false;
+  RoutingSearchStats stats;
+};
+
+// Knobs for AddRoutesByNegotiation.
+struct NegotiatedRoutingOptions {
+  RoutingSearchOptions search;
+  RoutingNetOrder order = RoutingNetOrder::kNetOrderGiven;
+
+  // Give up negotiating after this many rounds of rip-up and reroute.
+  size_t max_iterations = 30;
+
+  // How much a resource costs more for each other net using it, in the first
+  // iteration, and how much that grows by each iteration after.
+  double initial_present_factor = 0.5;
+  double present_factor_growth = 1.5;
+
+  // Added to the history of a resource for every net too many using it at the
+  // end of each iteration.
+  double history_increment = 0.5;
+};
+
+struct NegotiatedRoutingStats {
+  // Rounds of rip-up and reroute, including the first in which every net is
+  // routed.
+  size_t iterations = 0;
+  // True if the last iteration ended with no resource used by two nets.
+  bool converged = false;
+  // Shortest-path searches over all iterations, and their total work.
+  size_t searches = 0;
+  size_t vertices_expanded = 0;
+  // The number of resources used by more than one net after each iteration.
+  std::vector<size_t> overused_resources;
+  // Nets still in conflict when negotiation stopped (or whose paths could not
+  // be installed as found), which were routed again on what was left.
+  size_t nets_rerouted = 0;
+};
+
+// Knobs for AddRoutesInTiles.
+struct TiledRoutingOptions {
+  RoutingSearchOptions search;
+  RoutingNetOrder order = RoutingNetOrder::kNetOrderGiven;
+
+  // The routing area (the bounding box of the grid's vertices) is split into
+  // this many tiles in each direction.
+  size_t num_tiles_x = 8;
+  size_t num_tiles_y = 8;
+
+  // Tiles are shared between this many threads. The result does not depend on
+  // the number of threads.
+  size_t num_threads = 1;
+
+  // Nets left over after the tiles are routed by negotiation if set, or one
+  // at a time otherwise.
+  bool negotiate_remaining_nets = false;
+  NegotiatedRoutingOptions negotiation;
+};
+
+struct TiledRoutingStats {
+  size_t num_tiles = 0;
+  // Nets routed within a single tile.
+  size_t tile_nets_routed = 0;
+  // Nets left for after the tiles: those spanning tiles and those that could
+  // not be routed within theirs.
+  size_t remaining_nets = 0;
+  size_t remaining_nets_routed = 0;
+  // Total over all searches.
+  size_t vertices_expanded = 0;
+};
+
+// Knobs for AddRoutesWithGlobalRouting.
+struct GlobalRoutingOptions {
+  RoutingSearchOptions search;
+  RoutingNetOrder order = RoutingNetOrder::kNetOrderGiven;
+
+  // The width and height of each GCell, in tracks (of the widest pitch).
+  size_t gcell_tracks = 10;
+
+  // Corridors include the GCells this many away from the global route, which
+  // gives the detailed search room to get around what is already there.
+  size_t corridor_margin = 1;
+
+  // The extra cost of a global route crossing a GCell boundary that is
+  // already full.
+  double overflow_cost = 10.0;
+
+  // Nets that cannot be routed inside their corridor are routed over the
+  // whole grid if set.
+  bool fall_back_to_whole_grid = true;
+};
+
+struct GlobalRoutingStats {
+  size_t num_gcells = 0;
+  // GCell boundaries used by more global routes than have tracks across them.
+  size_t overflowed_boundaries = 0;
+  // Nets that could not be routed inside their corridors.
+  size_t corridor_failures = 0;
+  // Total over all detailed searches.
+  size_t vertices_expanded = 0;
+};
+
+// The work RoutingGrid did routing, by phase, for one net or for the whole
+// run. Times are wall time in seconds.
+struct RoutingPhaseStats {
+  // Routes made from a straight, L or Z pattern, without a search.
+  size_t pattern_routes = 0;
+
+  // Searches not made because their ends are in different connected
+  // components of the grid.
+  size_t unreachable_rejections = 0;
+
+  // Pin access: finding a vertex on the grid for each port, and the vertices
+  // made to bridge it there.
+  size_t pin_accesses = 0;
+  size_t pin_access_failures = 0;
+  size_t pin_access_vertices = 0;
+  double pin_access_seconds = 0;
+
+  // Searches, in total.
+  size_t searches = 0;
+  size_t vertices_expanded = 0;
+  size_t queue_pushes = 0;
+  size_t stale_pops = 0;
+  double search_seconds = 0;
+
+  // Search windows (see RoutingSearchOptions::window_margin_tracks): how many
+  // were tried, how many searches needed more than one, and the widest margin
+  // any search ended with.
+  size_t window_attempts = 0;
+  size_t windows_widened = 0;
+  int64_t widest_window_margin = 0;
+
+  // Installing paths: the edges used, the edges and vertices of the grid
+  // they made unusable, and how many blockages on their tracks were merged
+  // away as the spans they use were blocked.
+  size_t paths_installed = 0;
+  size_t edges_used = 0;
+  size_t edges_invalidated = 0;
+  size_t vertices_invalidated = 0;
+  size_t blockage_merges = 0;
+  double install_seconds = 0;
+};
+
+// Everything RoutingGrid has counted since it was made, or since the counts
+// were last reset.
+struct RoutingGridStats {
+  // Grid construction: ConnectLayers, ConnectLayersLazily and making the
+  // regions of lazy grids. Regions made for pin access or a search are
+  // counted here as well as in that phase's time.
+  size_t vertices_built = 0;
+  size_t regions_built = 0;
+  double build_seconds = 0;
+
+  // Connected components: how many times the whole grid was labelled, and
+  // how many times a component was found to have split by a failed search.
+  size_t component_labellings = 0;
+  size_t component_splits = 0;
+
+  RoutingPhaseStats totals;
+
+  // Keyed by the net of the port routed from. Ports on no named net are all
+  // counted under "".
+  std::map<std::string, RoutingPhaseStats> nets;
+};
+
 class RoutingGrid {
  public:
   RoutingGrid(const PhysicalPropertiesDatabase &physical_db)
-      : physical_db_(physical_db) {}
+      : vertex_index_cell_size_(1),
+        min_vertex_cost_(std::numeric_limits<double>::max()),
+        graph_stale_(true),
+        components_valid_(false),
+        num_components_(0),
+        counted_net_(nullptr),
+        physical_db_(physical_db) {}
 
   ~RoutingGrid() {
     for (auto entry : tracks_by_layer_) {
@@ -297,8 +671,7 @@ class RoutingGrid {
       }
     }
     for (RoutingPath *path : paths_) { delete path; }
-    for (RoutingEdge *edge : off_grid_edges_) { delete edge; }
-    for (RoutingVertex *vertex : vertices_) { delete vertex; }
+    // Every vertex and edge goes with the pools.
   }
 
   // Connecting two layers generates the graph that describes all the paths one
@@ -307,8 +680,90 @@ class RoutingGrid {
   // be orthogonal in routing direction.)
   void ConnectLayers(const Layer &first, const Layer &second);
 
+  // As ConnectLayers, but only the tracks are made up front. The vertices
+  // where they cross are made a region (of region_tracks by region_tracks
+  // crossings) at a time, when something first needs them: a port nearby, or
+  // a search between points nearby. Searches first get the regions around
+  // their ends, and more only if they fail there, so memory grows with the
+  // area actually explored. Blockages and used tracks are kept on the tracks
+  // as usual.
+  void ConnectLayersLazily(const Layer &first, const Layer &second,
+                           size_t region_tracks = 64);
+
+  // If stats is given, it is filled in with the work done by the search.
+  //
+  // With A* the path costs the same as Dijkstra's would, unless the search
+  // is held to a window (options.window_margin_tracks) or a pattern is used
+  // instead (options.try_patterns), when it can cost more.
   bool AddRouteBetween(
-      const Port &begin, const Port &end);
+      const Port &begin, const Port &end,
+      const RoutingSearchOptions &options = RoutingSearchOptions(),
+      RoutingSearchStats *stats = nullptr);
+
+  // Routes many nets at once, in the given order. The result for nets[i] is
+  // stored in (*results)[i]. Ports must outlive the grid, as with
+  // AddRouteBetween. Returns the number of nets routed.
+  size_t AddRoutesBetween(
+      const std::vector<RoutingNet> &nets,
+      const RoutingNetOrder &order,
+      const RoutingSearchOptions &options,
+      std::vector<RoutingNetResult> *results);
+
+  // Connects all of the given ports, which should be on the same net, with a
+  // tree of paths. Each port after the first is joined to whichever point on
+  // the tree so far is closest, so the net's wires are shared instead of
+  // duplicated, and the nearest unconnected port is always joined next. The
+  // tree is installed once it is complete. Returns false if any port could not
+  // be connected; the rest still are. If stats is given it is filled in with
+  // the total work done and the cost of the tree.
+  bool AddMultiPointRoute(
+      const std::vector<const Port*> &ports,
+      const RoutingSearchOptions &options = RoutingSearchOptions(),
+      RoutingSearchStats *stats = nullptr);
+
+  // Routes many nets at once with negotiated congestion (PathFinder): nets are
+  // first routed allowing them to share resources, and then those sharing are
+  // ripped up and rerouted, with shared resources getting more expensive each
+  // time, until no two nets share any. The paths are then installed as with
+  // AddRoutesBetween. If stats is given it is filled in.
+  //
+  // The resources are the tracks through each vertex: nets may cross at a
+  // vertex, one on each track, but not both use the same track there.
+  size_t AddRoutesByNegotiation(
+      const std::vector<RoutingNet> &nets,
+      const NegotiatedRoutingOptions &options,
+      std::vector<RoutingNetResult> *results,
+      NegotiatedRoutingStats *stats = nullptr);
+
+  // Routes many nets at once, using many threads. The routing area is split
+  // into tiles, and nets with both ends in the same tile are routed without
+  // leaving it. Since no two tiles share a vertex they are routed in parallel.
+  // The rest of the nets are then routed on what is left. Within a tile, and
+  // afterwards, nets are routed in the given order.
+  size_t AddRoutesInTiles(
+      const std::vector<RoutingNet> &nets,
+      const TiledRoutingOptions &options,
+      std::vector<RoutingNetResult> *results,
+      TiledRoutingStats *stats = nullptr);
+
+  // Routes many nets at once, in two stages. Global routing first routes
+  // every net over a coarse grid of GCells covering the routing layers,
+  // assigning layers as it goes, and each net's detailed search is then
+  // confined to a corridor of GCells around its global route. Nets are
+  // routed in the given order in both stages.
+  size_t AddRoutesWithGlobalRouting(
+      const std::vector<RoutingNet> &nets,
+      const GlobalRoutingOptions &options,
+      std::vector<RoutingNetResult> *results,
+      GlobalRoutingStats *stats = nullptr);
+
+  // Rips up an installed path, gives the tracks it used back to the grid, and
+  // deletes it. Each track it used is joined up again across the spans it had
+  // blocked. Its vertices go back on whichever of their tracks can still take
+  // them, unless they were only made to reach its ports, and are otherwise
+  // deleted. Only those tracks are touched. Returns false if the path is not
+  // installed here.
+  bool RemovePath(RoutingPath *path);
 
   void AddVertex(RoutingVertex *vertex);
 
@@ -318,6 +773,30 @@ class RoutingGrid {
   // Caller takes ownership.
   PolyLineCell *CreatePolyLineCell() const;
 
+  // Writes the whole grid (tracks, vertices, edges, blockages, installed paths
+  // and lazy connections) to a flat, versioned binary file, so that a later
+  // run can read it back instead of building the grid again. Returns false if
+  // the file could not be written.
+  bool WriteSnapshot(const std::string &filename) const;
+
+  // Reads a file written by WriteSnapshot into this grid, which must be new
+  // and have the same PhysicalPropertiesDatabase. The grid is then as it was
+  // when written, except that installed paths have lost their ports, which
+  // were not written. Returns false, and leaves the grid alone, if the file
+  // cannot be read or was written by a different version.
+  bool ReadSnapshot(const std::string &filename);
+
+  // The work done so far, by phase and by net.
+  const RoutingGridStats &stats() const { return stats_; }
+  void ResetStats() {
+    stats_ = RoutingGridStats();
+    counted_net_ = nullptr;
+  }
+
+  // Writes stats() to a file as JSON. Returns false if the file could not be
+  // written.
+  bool WriteStatsReport(const std::string &filename) const;
+
   const std::vector<RoutingPath*> &paths() const { return paths_; }
   const std::set<RoutingEdge*> &off_grid_edges() const {
     return off_grid_edges_;
@@ -327,44 +806,248 @@ class RoutingGrid {
   const PhysicalPropertiesDatabase &physical_db() const { return physical_db_; }
 
  private:
+  // The crossings between the tracks of two layers connected lazily, and
+  // which regions of them have been made into vertices.
+  struct LazyConnection {
+    Layer first;
+    Layer second;
+    double via_cost;
+    // The offsets of the tracks in each direction, in ascending order.
+    std::vector<int64_t> xs;
+    std::vector<RoutingTrack*> vertical_tracks;
+    std::vector<int64_t> ys;
+    std::vector<RoutingTrack*> horizontal_tracks;
+    size_t region_tracks = 0;
+    size_t num_regions_x = 0;
+    size_t num_regions_y = 0;
+    std::vector<bool> materialised;
+    size_t num_materialised = 0;
+  };
+
+  // The vertices made for an attempt at a route, in the order they were
+  // made, so that the grid can be put back as it was if the attempt fails.
+  // Handles are kept since other paths may delete the vertices meanwhile.
+  struct RoutingUndoLog {
+    std::vector<RoutingHandle> vertices;
+  };
+
   RoutingLayerInfo *FindRoutingInfoOrDie(const Layer &layer);
 
+  // Makes the tracks for ConnectLayers and ConnectLayersLazily.
+  LazyConnection MakeTracks(const Layer &first, const Layer &second);
+
+  // Makes the vertex where the ith vertical and jth horizontal tracks cross.
+  RoutingVertex *AddCrossing(
+      const LazyConnection &connection, size_t i, size_t j);
+
+  // Makes the vertices of all lazily connected regions overlapping the area.
+  void Materialise(const Rectangle &area);
+
+  // Materialises the bounding box of the points, grown by margin.
+  void MaterialiseAround(const std::vector<Point> &points, int64_t margin);
+
+  // Materialises the bounding box of all the nets' ports, grown by a region.
+  void MaterialiseAroundNets(const std::vector<RoutingNet> &nets);
+
+  bool FullyMaterialised() const;
+
+  // The width of the largest lazy region, or 0 if there are none.
+  int64_t LazyRegionSize() const;
+
+  // The widest pitch of any layer with tracks.
+  int64_t MaxPitch() const;
+
+  // Whether a path could join the two vertices, as far as the connected
+  // components of the grid tell. If this returns false there is no path
+  // between them. Nothing is ruled out on a lazy grid not yet fully made.
+  bool MaybeConnected(RoutingVertex *begin, RoutingVertex *end);
+
+  // Labels every available vertex with its connected component.
+  void LabelComponents();
+
+  // Gives everything reachable from the vertex a new component label, after
+  // a search from it has found its component smaller than labelled.
+  void SplitComponent(RoutingVertex *vertex);
+
   std::pair<std::reference_wrapper<const RoutingLayerInfo>,
             std::reference_wrapper<const RoutingLayerInfo>>
       PickHorizontalAndVertical(
           const Layer &lhs, const Layer &rhs) const;
 
-  std::vector<RoutingVertex*> &GetAvailableVertices(const Layer &layer);
+  RoutingVertexIndex &GetAvailableVertices(const Layer &layer);
 
+  // Any vertices made are recorded in undo_log, if given.
   RoutingVertex *GenerateGridVertexForPoint(
-      const Point &point, const Layer &layer);
+      const Point &point, const Layer &layer, RoutingUndoLog *undo_log);
+
+  // The work of GenerateGridVertexForPoint, which counts it as pin access.
+  RoutingVertex *FindOrMakeGridVertexForPoint(
+      const Point &point, const Layer &layer, RoutingUndoLog *undo_log);
+
+  // Counts the work done from now on against the net of the given port, as
+  // well as against the totals.
+  void CountNet(const Port &port);
+  void StopCountingNet() { counted_net_ = nullptr; }
+
+  // The totals, and the counted net if there is one.
+  std::vector<RoutingPhaseStats*> CountedPhases();
+
+  // Adds a search done with FindShortestPath to the counts.
+  void CountSearch(const RoutingSearchStats &search_stats);
+
+  // Removes and deletes the vertices in the log, newest first, along with
+  // their edges. Those since deleted, or used by an installed path, are left
+  // alone. The log is cleared.
+  void RollBack(RoutingUndoLog *undo_log);
+
+  // The work of AddRouteBetween, without the chatter.
+  bool RouteBetween(
+      const Port &begin, const Port &end,
+      const RoutingSearchOptions &options,
+      RoutingSearchStats *stats);
+
+  // Finds the first of the patterns tried by RoutingSearchOptions::try_patterns
+  // that fits between begin and end, and stores its edges, in order, in
+  // edges_out. Off-grid ends are joined to the pattern by their only edge.
+  // Returns false if none fit.
+  bool FindPatternPath(RoutingVertex *begin, RoutingVertex *end,
+                       std::deque<RoutingEdge*> *edges_out) const;
+
+  // Returns the indices of nets in the order they should be routed.
+  static std::vector<size_t> OrderNets(
+      const std::vector<RoutingNet> &nets, const RoutingNetOrder &order);
 
   // Returns nullptr if no path found. If a RoutingPath is found, the caller
-  // now owns the object.
+  // now owns the object. The work done is added to stats, which must not be
+  // nullptr. Unless the limits give a window or corridor, the search is held
+  // to a growing window as set by options.window_margin_tracks.
   RoutingPath *ShortestPath(
-      RoutingVertex *begin, RoutingVertex *end);
+      RoutingVertex *begin, RoutingVertex *end,
+      const RoutingSearchOptions &options,
+      const RoutingSearchLimits &limits,
+      RoutingSearchStats *stats);
+
+  // The search behind ShortestPath, from whichever of the begins is closest
+  // to end. On success the slots in graph_ of the edges from there to end are
+  // stored, in order, in slots_out, and the begin used in begin_out if given.
+  //
+  // graph_ must be up to date. The search only reads the grid, so searches
+  // with their own workspaces may run at the same time.
+  bool FindShortestPath(
+      const std::vector<RoutingVertex*> &begins, RoutingVertex *end,
+      const RoutingSearchOptions &options,
+      const RoutingSearchLimits &limits,
+      RoutingSearchWorkspace *workspace,
+      RoutingSearchStats *stats,
+      std::vector<size_t> *slots_out,
+      RoutingVertex **begin_out = nullptr) const;
+
+  // The unscaled cost of following the given slots in graph_ from the vertex
+  // at begin_index.
+  double PathCost(size_t begin_index, const std::vector<size_t> &slots) const;
+
+  // Caller takes ownership.
+  RoutingPath *PathFromSlots(
+      RoutingVertex *begin, const std::vector<size_t> &slots) const;
+
+  // Rebuilds a path found in graph_ (given as the vertices it visits, their
+  // indices and the slots between them) after other paths have been installed
+  // over it. Vertices the path went straight through may be gone, so long as
+  // the track still joins the vertices either side. Returns nullptr if the
+  // path can no longer be made. Caller takes ownership.
+  RoutingPath *RebuildPath(
+      const std::vector<RoutingVertex*> &vertices,
+      const std::vector<size_t> &indices,
+      const std::vector<size_t> &slots) const;
+
+  // Appends the edges joining each of the given vertices to the next, either
+  // along the track they share (through any vertices added between them since)
+  // or by the off-grid edge between them, to edges_out. Returns false if some
+  // pair is no longer joined.
+  bool EdgesThrough(const std::vector<RoutingVertex*> &vertices,
+                    std::vector<RoutingEdge*> *edges_out) const;
+
+  // A lower bound on the cost of any path to end from vertex, having arrived
+  // there in the given direction, for A*. Edges cost at least their length, so
+  // the Manhattan distance is a lower bound on the wire cost. Unless the path
+  // can carry straight on to end, it must turn somewhere, and so pay for at
+  // least one vertex.
+  double LowerBoundCostToEnd(
+      const Point &vertex,
+      const RoutingTrackDirection &arrival,
+      const Point &end) const;
 
   // Takes ownership of the given object and accounts for the path's resources
   // as used.
   void InstallPath(RoutingPath *path);
 
+  // As InstallPath, for paths which may share vertices (where one branches
+  // off another on the same net), so must be installed together.
+  void InstallPaths(const std::vector<RoutingPath*> &paths);
+
   void AddTrackToLayer(RoutingTrack *track, const Layer &layer);
 
+  // The edges of the vertex and its neighbours on its tracks are about to
+  // change (or just have), so their copy in graph_ must be refreshed.
+  void MarkNeighbourhoodDirty(RoutingVertex *vertex);
+
+  // Brings graph_ up to date before a search.
+  void RefreshGraph();
+
   // All installed paths (which we also own).
   std::vector<RoutingPath*> paths_;
 
-  // Edges that do not fall on tracks, so we own them (until they are contained
-  // in a RoutingPath).
+  // Every vertex and edge is made in these. They are kept until the grid is
+  // destroyed, unless they are removed without being used by any path.
+  // Paths only refer to them, and pointers into the pools are stable.
+  RoutingObjectPool<RoutingVertex> vertex_pool_;
+  RoutingObjectPool<RoutingEdge> edge_pool_;
+
+  // Edges that do not fall on tracks, so we look after them (until they are
+  // contained in a RoutingPath).
   std::set<RoutingEdge*> off_grid_edges_;
 
-  // All owned vertices.
+  // All vertices available to paths.
   std::vector<RoutingVertex*> vertices_;
 
   // All routing tracks (we own these).
   std::map<Layer, std::vector<RoutingTrack*>> tracks_by_layer_;
 
-  // The list of all available vertices per layer.
-  std::map<Layer, std::vector<RoutingVertex*>> available_vertices_by_layer_;
+  // Layers connected by ConnectLayersLazily.
+  std::vector<LazyConnection> lazy_connections_;
+
+  // All available vertices per layer, indexed by position.
+  std::map<Layer, RoutingVertexIndex> available_vertices_by_layer_;
+
+  // The size of the cells in new RoutingVertexIndexes: the widest pitch of
+  // any layers connected so far.
+  int64_t vertex_index_cell_size_;
+
+  // The cheapest vertex ever added, usually the cheapest via. Used to bound
+  // the cost of turns in LowerBoundCostToEnd.
+  double min_vertex_cost_;
+
+  // The compact copy of the graph that ShortestPath searches. It is patched as
+  // vertices come and go, and rebuilt from scratch if graph_stale_ (for
+  // example, after ConnectLayers).
+  RoutingGraphView graph_;
+  bool graph_stale_;
+
+  // Vertices are labelled with their connected components (by following
+  // their edges) when first needed. Labels are kept up to date as vertices
+  // are added. Taking edges and vertices away can only split components, so
+  // labels that differ stay right without relabelling. Labels that are the
+  // same might be wrong, and a search finds that out. Anything that might
+  // join components unseen makes the labels invalid.
+  bool components_valid_;
+  size_t num_components_;
+
+  // Reused by every call to ShortestPath.
+  RoutingSearchWorkspace workspace_;
+
+  RoutingGridStats stats_;
+  // The entry in stats_.nets that work is also counted against, if any.
+  RoutingPhaseStats *counted_net_;
 
   const PhysicalPropertiesDatabase &physical_db_;
 };
@@ -0,0 +1,645 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_grid.h"
+
+// RoutingGrid::WriteSnapshot and RoutingGrid::ReadSnapshot.
+//
+// A snapshot is a flat run of fixed-size values in the writer's byte order:
+//
+//    header:       magic, version, byte order mark
+//    grid:         vertex index cell size, cheapest vertex cost
+//    tracks:       layer, direction, offset, pitch start and pitch, blocked
+//                  spans, vertex numbers
+//    vertices:     centre, cost, flags, track numbers, layers, edge numbers
+//    edges:        vertex numbers, cost, layer, track number, flags
+//    grid order:   the numbers of the vertices available to paths, in order
+//    paths:        start vertex number, edge numbers
+//    lazy layers:  as RoutingGrid::LazyConnection
+//
+// Objects refer to one another by their position in these lists. The whole
+// file is read at once and checked before anything is made from it.
+
+namespace boralago {
+
+namespace {
+
+constexpr char kSnapshotMagic[8] = {'B', 'R', 'L', 'G', 'G', 'R', 'I', 'D'};
+
+// This must change whenever the layout does, so that old snapshots are
+// refused instead of misread.
+constexpr uint32_t kSnapshotVersion = 3;
+
+// Snapshots are not portable between machines of different byte order, which
+// this catches.
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+// The number of a missing track, vertex or edge.
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+// Where an edge is kept.
+enum SnapshotEdgePlace : uint8_t {
+  kEdgeOnTrack = 0,
+  kEdgeOffGrid = 1,
+  kEdgeInPath = 2
+};
+
+class SnapshotWriter {
+ public:
+  template <typename T>
+  void Put(const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only plain values can be written");
+    buffer_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T>
+  void PutVector(const std::vector<T> &values) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only plain values can be written");
+    Put<uint64_t>(values.size());
+    buffer_.append(reinterpret_cast<const char*>(values.data()),
+                   values.size() * sizeof(T));
+  }
+
+  const std::string &buffer() const { return buffer_; }
+
+ private:
+  std::string buffer_;
+};
+
+// Reads back what SnapshotWriter wrote, failing instead of reading past the
+// end of the buffer.
+class SnapshotReader {
+ public:
+  SnapshotReader(const std::string &buffer) : buffer_(buffer), offset_(0) {}
+
+  template <typename T>
+  bool Get(T *value) {
+    if (buffer_.size() - offset_ < sizeof(T))
+      return false;
+    std::memcpy(value, buffer_.data() + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  bool GetVector(std::vector<T> *values) {
+    uint64_t size;
+    if (!Get(&size) || size > (buffer_.size() - offset_) / sizeof(T))
+      return false;
+    values->resize(size);
+    std::memcpy(values->data(), buffer_.data() + offset_, size * sizeof(T));
+    offset_ += size * sizeof(T);
+    return true;
+  }
+
+  bool AtEnd() const { return offset_ == buffer_.size(); }
+
+ private:
+  const std::string &buffer_;
+  size_t offset_;
+};
+
+struct TrackRecord {
+  Layer layer;
+  uint8_t direction;
+  int64_t offset;
+  int64_t pitch_start;
+  int64_t pitch;
+  // The low and high ends of each span, one after the other.
+  std::vector<int64_t> blocked_spans;
+  std::vector<uint32_t> vertices;
+};
+
+struct VertexRecord {
+  int64_t x;
+  int64_t y;
+  double cost;
+  uint8_t available;
+  uint8_t bridging;
+  uint32_t horizontal_track;
+  uint32_t vertical_track;
+  uint32_t path_count;
+  std::vector<Layer> layers;
+  std::vector<uint32_t> edges;
+};
+
+struct EdgeRecord {
+  uint32_t first;
+  uint32_t second;
+  double cost;
+  Layer layer;
+  uint32_t track;
+  uint8_t available;
+  uint8_t place;
+};
+
+struct PathRecord {
+  uint32_t start;
+  std::vector<uint32_t> edges;
+};
+
+struct LazyRecord {
+  Layer first;
+  Layer second;
+  double via_cost;
+  std::vector<int64_t> xs;
+  std::vector<uint32_t> vertical_tracks;
+  std::vector<int64_t> ys;
+  std::vector<uint32_t> horizontal_tracks;
+  uint64_t region_tracks;
+  uint64_t num_regions_x;
+  uint64_t num_regions_y;
+  std::vector<uint8_t> materialised;
+};
+
+bool AllBelow(const std::vector<uint32_t> &numbers, size_t limit) {
+  for (uint32_t number : numbers) {
+    if (number >= limit)
+      return false;
+  }
+  return true;
+}
+
+// Whether every (low, high) pair in the flattened spans has low < high, as a
+// RoutingTrackBlockage must.
+bool AllSpansOrdered(const std::vector<int64_t> &spans) {
+  for (size_t i = 0; i + 1 < spans.size(); i += 2) {
+    if (spans[i] >= spans[i + 1])
+      return false;
+  }
+  return true;
+}
+
+// Whether the track's vertices, whose numbers must already be known to be
+// valid, all lie on it in strictly increasing order along it, as
+// RoutingTrack keeps them.
+bool TrackVerticesInOrder(const TrackRecord &track,
+                          const std::vector<VertexRecord> &vertices) {
+  bool horizontal =
+      track.direction == RoutingTrackDirection::kTrackHorizontal;
+  for (size_t i = 0; i < track.vertices.size(); ++i) {
+    const VertexRecord &vertex = vertices[track.vertices[i]];
+    if ((horizontal ? vertex.y : vertex.x) != track.offset)
+      return false;
+    if (i == 0)
+      continue;
+    const VertexRecord &previous = vertices[track.vertices[i - 1]];
+    if (horizontal ? previous.x >= vertex.x : previous.y >= vertex.y)
+      return false;
+  }
+  return true;
+}
+
+}   // namespace
+
+bool RoutingGrid::WriteSnapshot(const std::string &filename) const {
+  // Tracks are numbered in the order they are written.
+  std::map<const RoutingTrack*, uint32_t> track_numbers;
+  std::vector<const RoutingTrack*> tracks;
+  for (const auto &entry : tracks_by_layer_) {
+    for (const RoutingTrack *track : entry.second) {
+      track_numbers[track] = tracks.size();
+      tracks.push_back(track);
+    }
+  }
+  auto track_number = [&](const RoutingTrack *track) {
+    return track == nullptr ? kNone : track_numbers.at(track);
+  };
+
+  // The vertices available to paths come first, in order, then those only
+  // in installed paths. Their numbers are looked up by pool slot.
+  std::vector<uint32_t> vertex_numbers(vertex_pool_.num_slots(), kNone);
+  std::vector<const RoutingVertex*> vertices;
+  auto number_vertex = [&](const RoutingVertex *vertex) {
+    uint32_t &number = vertex_numbers[vertex_pool_.HandleOf(vertex).index];
+    if (number == kNone) {
+      number = vertices.size();
+      vertices.push_back(vertex);
+    }
+  };
+  for (const RoutingVertex *vertex : vertices_)
+    number_vertex(vertex);
+  for (const RoutingPath *path : paths_) {
+    for (const RoutingVertex *vertex : path->vertices())
+      number_vertex(vertex);
+  }
+
+  // Every edge is on one of those vertices, unless it is in a path.
+  std::vector<uint32_t> edge_numbers(edge_pool_.num_slots(), kNone);
+  std::vector<RoutingEdge*> edges;
+  auto number_edge = [&](RoutingEdge *edge) {
+    uint32_t &number = edge_numbers[edge_pool_.HandleOf(edge).index];
+    if (number == kNone) {
+      number = edges.size();
+      edges.push_back(edge);
+    }
+    return number;
+  };
+  for (const RoutingVertex *vertex : vertices) {
+    for (RoutingEdge *edge : vertex->edges())
+      number_edge(edge);
+  }
+  for (const RoutingPath *path : paths_) {
+    for (RoutingEdge *edge : path->edges())
+      number_edge(edge);
+  }
+  auto vertex_number = [&](const RoutingVertex *vertex) {
+    return vertex_numbers[vertex_pool_.HandleOf(vertex).index];
+  };
+  auto edge_number = [&](const RoutingEdge *edge) {
+    return edge_numbers[edge_pool_.HandleOf(edge).index];
+  };
+
+  SnapshotWriter writer;
+  for (char c : kSnapshotMagic)
+    writer.Put(c);
+  writer.Put(kSnapshotVersion);
+  writer.Put(kByteOrderMark);
+
+  writer.Put<int64_t>(vertex_index_cell_size_);
+  writer.Put<double>(min_vertex_cost_);
+
+  writer.Put<uint64_t>(tracks.size());
+  for (const RoutingTrack *track : tracks) {
+    writer.Put<Layer>(track->layer());
+    writer.Put<uint8_t>(track->direction());
+    writer.Put<int64_t>(track->offset());
+    writer.Put<int64_t>(track->occupancy().start());
+    writer.Put<int64_t>(track->occupancy().pitch());
+    std::vector<int64_t> blocked_spans;
+    for (const auto &span : track->blocked_spans()) {
+      blocked_spans.push_back(span.first);
+      blocked_spans.push_back(span.second);
+    }
+    writer.PutVector(blocked_spans);
+    std::vector<uint32_t> track_vertices;
+    for (const auto &entry : track->vertices_by_position())
+      track_vertices.push_back(vertex_number(entry.second));
+    writer.PutVector(track_vertices);
+  }
+
+  writer.Put<uint64_t>(vertices.size());
+  for (const RoutingVertex *vertex : vertices) {
+    writer.Put<int64_t>(vertex->centre().x());
+    writer.Put<int64_t>(vertex->centre().y());
+    writer.Put<double>(vertex->cost());
+    writer.Put<uint8_t>(vertex->available());
+    writer.Put<uint8_t>(vertex->bridging());
+    writer.Put<uint32_t>(track_number(vertex->horizontal_track()));
+    writer.Put<uint32_t>(track_number(vertex->vertical_track()));
+    writer.Put<uint32_t>(vertex->path_count());
+    writer.PutVector(vertex->connected_layers());
+    std::vector<uint32_t> vertex_edges;
+    for (const RoutingEdge *edge : vertex->edges())
+      vertex_edges.push_back(edge_number(edge));
+    writer.PutVector(vertex_edges);
+  }
+
+  writer.Put<uint64_t>(edges.size());
+  for (RoutingEdge *edge : edges) {
+    RoutingTrack *track = edge->track();
+    uint8_t place = kEdgeInPath;
+    if (track != nullptr && track->edges().count(edge) > 0) {
+      place = kEdgeOnTrack;
+    } else if (off_grid_edges_.count(edge) > 0) {
+      place = kEdgeOffGrid;
+    }
+    writer.Put<uint32_t>(vertex_number(edge->first()));
+    writer.Put<uint32_t>(vertex_number(edge->second()));
+    writer.Put<double>(edge->cost());
+    writer.Put<Layer>(edge->ExplicitOrTrackLayer());
+    writer.Put<uint32_t>(track_number(track));
+    writer.Put<uint8_t>(edge->available());
+    writer.Put<uint8_t>(place);
+  }
+
+  std::vector<uint32_t> grid_vertices;
+  for (const RoutingVertex *vertex : vertices_)
+    grid_vertices.push_back(vertex_number(vertex));
+  writer.PutVector(grid_vertices);
+
+  writer.Put<uint64_t>(paths_.size());
+  for (const RoutingPath *path : paths_) {
+    writer.Put<uint32_t>(vertex_number(path->Begin()));
+    std::vector<uint32_t> path_edges;
+    for (const RoutingEdge *edge : path->edges())
+      path_edges.push_back(edge_number(edge));
+    writer.PutVector(path_edges);
+  }
+
+  writer.Put<uint64_t>(lazy_connections_.size());
+  for (const LazyConnection &connection : lazy_connections_) {
+    writer.Put<Layer>(connection.first);
+    writer.Put<Layer>(connection.second);
+    writer.Put<double>(connection.via_cost);
+    std::vector<uint32_t> vertical_tracks;
+    for (const RoutingTrack *track : connection.vertical_tracks)
+      vertical_tracks.push_back(track_number(track));
+    std::vector<uint32_t> horizontal_tracks;
+    for (const RoutingTrack *track : connection.horizontal_tracks)
+      horizontal_tracks.push_back(track_number(track));
+    writer.PutVector(connection.xs);
+    writer.PutVector(vertical_tracks);
+    writer.PutVector(connection.ys);
+    writer.PutVector(horizontal_tracks);
+    writer.Put<uint64_t>(connection.region_tracks);
+    writer.Put<uint64_t>(connection.num_regions_x);
+    writer.Put<uint64_t>(connection.num_regions_y);
+    writer.PutVector(std::vector<uint8_t>(connection.materialised.begin(),
+                                          connection.materialised.end()));
+  }
+
+  std::fstream output(
+      filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+  output.write(writer.buffer().data(), writer.buffer().size());
+  output.close();
+  if (!output) {
+    LOG(ERROR) << "Could not write grid snapshot to " << filename;
+    return false;
+  }
+  LOG(INFO) << "Wrote grid snapshot with " << vertices.size() << " vertices, "
+            << edges.size() << " edges and " << paths_.size()
+            << " paths to " << filename;
+  return true;
+}
+
+bool RoutingGrid::ReadSnapshot(const std::string &filename) {
+  if (!tracks_by_layer_.empty() || !vertices_.empty() || !paths_.empty()) {
+    LOG(ERROR) << "Grid snapshots can only be read into an empty grid";
+    return false;
+  }
+
+  std::fstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!input) {
+    LOG(ERROR) << "Could not open grid snapshot " << filename;
+    return false;
+  }
+  input.seekg(0, std::ios::end);
+  std::string buffer(static_cast<size_t>(input.tellg()), '\0');
+  input.seekg(0, std::ios::beg);
+  input.read(&buffer[0], buffer.size());
+  if (!input) {
+    LOG(ERROR) << "Could not read grid snapshot " << filename;
+    return false;
+  }
+
+  // Read and check everything before changing the grid.
+  SnapshotReader reader(buffer);
+  char magic[sizeof(kSnapshotMagic)];
+  uint32_t version = 0;
+  uint32_t byte_order_mark = 0;
+  bool ok = true;
+  for (char &c : magic)
+    ok = ok && reader.Get(&c);
+  ok = ok && reader.Get(&version) && reader.Get(&byte_order_mark);
+  if (!ok ||
+      std::memcmp(magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+      version != kSnapshotVersion ||
+      byte_order_mark != kByteOrderMark) {
+    LOG(ERROR) << filename << " is not a version " << kSnapshotVersion
+               << " grid snapshot for this machine";
+    return false;
+  }
+
+  int64_t cell_size = 0;
+  double min_vertex_cost = 0;
+  ok = reader.Get(&cell_size) && reader.Get(&min_vertex_cost);
+
+  uint64_t num_tracks = 0;
+  ok = ok && reader.Get(&num_tracks);
+  std::vector<TrackRecord> track_records;
+  for (uint64_t i = 0; ok && i < num_tracks; ++i) {
+    TrackRecord record;
+    ok = reader.Get(&record.layer) && reader.Get(&record.direction) &&
+        reader.Get(&record.offset) &&
+        reader.Get(&record.pitch_start) && reader.Get(&record.pitch) &&
+        record.pitch >= 0 &&
+        reader.GetVector(&record.blocked_spans) &&
+        reader.GetVector(&record.vertices) &&
+        record.blocked_spans.size() % 2 == 0 &&
+        record.direction <= RoutingTrackDirection::kTrackVertical;
+    track_records.push_back(std::move(record));
+  }
+
+  uint64_t num_vertices = 0;
+  ok = ok && reader.Get(&num_vertices) && num_vertices < kNone;
+  std::vector<VertexRecord> vertex_records;
+  // The count is not trusted until the records are there, but it cannot be
+  // more than the bytes left.
+  vertex_records.reserve(std::min(num_vertices, buffer.size()));
+  for (uint64_t i = 0; ok && i < num_vertices; ++i) {
+    VertexRecord record;
+    ok = reader.Get(&record.x) && reader.Get(&record.y) &&
+        reader.Get(&record.cost) && reader.Get(&record.available) &&
+        reader.Get(&record.bridging) &&
+        reader.Get(&record.horizontal_track) &&
+        reader.Get(&record.vertical_track) &&
+        reader.Get(&record.path_count) &&
+        reader.GetVector(&record.layers) &&
+        reader.GetVector(&record.edges) &&
+        (record.horizontal_track == kNone ||
+         record.horizontal_track < num_tracks) &&
+        (record.vertical_track == kNone ||
+         record.vertical_track < num_tracks);
+    vertex_records.push_back(std::move(record));
+  }
+
+  uint64_t num_edges = 0;
+  ok = ok && reader.Get(&num_edges) && num_edges < kNone;
+  std::vector<EdgeRecord> edge_records;
+  edge_records.reserve(std::min(num_edges, buffer.size()));
+  for (uint64_t i = 0; ok && i < num_edges; ++i) {
+    EdgeRecord record;
+    ok = reader.Get(&record.first) && reader.Get(&record.second) &&
+        reader.Get(&record.cost) && reader.Get(&record.layer) &&
+        reader.Get(&record.track) && reader.Get(&record.available) &&
+        reader.Get(&record.place) &&
+        record.first < num_vertices && record.second < num_vertices &&
+        (record.track == kNone || record.track < num_tracks) &&
+        record.place <= kEdgeInPath &&
+        (record.place != kEdgeOnTrack || record.track != kNone);
+    edge_records.push_back(record);
+  }
+
+  std::vector<uint32_t> grid_vertices;
+  ok = ok && reader.GetVector(&grid_vertices) &&
+      AllBelow(grid_vertices, num_vertices);
+
+  uint64_t num_paths = 0;
+  ok = ok && reader.Get(&num_paths);
+  std::vector<PathRecord> path_records;
+  for (uint64_t i = 0; ok && i < num_paths; ++i) {
+    PathRecord record;
+    ok = reader.Get(&record.start) && reader.GetVector(&record.edges) &&
+        record.start < num_vertices && AllBelow(record.edges, num_edges);
+    path_records.push_back(std::move(record));
+  }
+
+  uint64_t num_lazy = 0;
+  ok = ok && reader.Get(&num_lazy);
+  std::vector<LazyRecord> lazy_records;
+  for (uint64_t i = 0; ok && i < num_lazy; ++i) {
+    LazyRecord record;
+    ok = reader.Get(&record.first) && reader.Get(&record.second) &&
+        reader.Get(&record.via_cost) && reader.GetVector(&record.xs) &&
+        reader.GetVector(&record.vertical_tracks) &&
+        reader.GetVector(&record.ys) &&
+        reader.GetVector(&record.horizontal_tracks) &&
+        reader.Get(&record.region_tracks) &&
+        reader.Get(&record.num_regions_x) &&
+        reader.Get(&record.num_regions_y) &&
+        reader.GetVector(&record.materialised) &&
+        record.xs.size() == record.vertical_tracks.size() &&
+        record.ys.size() == record.horizontal_tracks.size() &&
+        AllBelow(record.vertical_tracks, num_tracks) &&
+        AllBelow(record.horizontal_tracks, num_tracks) &&
+        record.materialised.size() ==
+            record.num_regions_x * record.num_regions_y;
+    lazy_records.push_back(std::move(record));
+  }
+
+  for (const TrackRecord &record : track_records) {
+    ok = ok && AllBelow(record.vertices, num_vertices) &&
+        TrackVerticesInOrder(record, vertex_records) &&
+        AllSpansOrdered(record.blocked_spans);
+  }
+  for (const VertexRecord &record : vertex_records)
+    ok = ok && AllBelow(record.edges, num_edges);
+  if (!ok || !reader.AtEnd()) {
+    LOG(ERROR) << "Grid snapshot " << filename << " is corrupt";
+    return false;
+  }
+
+  // Now make it all.
+  vertex_index_cell_size_ = cell_size;
+  min_vertex_cost_ = min_vertex_cost;
+
+  std::vector<RoutingTrack*> tracks;
+  for (const TrackRecord &record : track_records) {
+    RoutingTrack *track = new RoutingTrack(
+        record.layer, static_cast<RoutingTrackDirection>(record.direction),
+        record.offset, &vertex_pool_, &edge_pool_);
+    track->SetPitch(record.pitch_start, record.pitch);
+    AddTrackToLayer(track, record.layer);
+    tracks.push_back(track);
+  }
+  auto track_at = [&](uint32_t number) {
+    return number == kNone ? nullptr : tracks[number];
+  };
+
+  std::vector<RoutingVertex*> vertices;
+  vertices.reserve(vertex_records.size());
+  for (const VertexRecord &record : vertex_records) {
+    RoutingVertex *vertex = vertex_pool_.New(Point(record.x, record.y));
+    vertex->set_cost(record.cost);
+    vertex->set_available(record.available != 0);
+    vertex->set_bridging(record.bridging != 0);
+    vertex->set_horizontal_track(track_at(record.horizontal_track));
+    vertex->set_vertical_track(track_at(record.vertical_track));
+    vertex->set_path_count(record.path_count);
+    for (const Layer &layer : record.layers)
+      vertex->AddConnectedLayer(layer);
+    vertices.push_back(vertex);
+  }
+
+  std::vector<RoutingEdge*> edges;
+  edges.reserve(edge_records.size());
+  std::vector<std::vector<RoutingEdge*>> track_edges(tracks.size());
+  for (const EdgeRecord &record : edge_records) {
+    RoutingEdge *edge = edge_pool_.New(
+        vertices[record.first], vertices[record.second]);
+    edge->set_cost(record.cost);
+    edge->set_layer(record.layer);
+    edge->set_track(track_at(record.track));
+    edge->set_available(record.available != 0);
+    if (record.place == kEdgeOnTrack) {
+      track_edges[record.track].push_back(edge);
+    } else if (record.place == kEdgeOffGrid) {
+      off_grid_edges_.insert(edge);
+    }
+    edges.push_back(edge);
+  }
+  for (size_t i = 0; i < vertex_records.size(); ++i) {
+    for (uint32_t number : vertex_records[i].edges)
+      vertices[i]->AddEdge(edges[number]);
+  }
+
+  for (size_t i = 0; i < track_records.size(); ++i) {
+    std::vector<RoutingVertex*> track_vertices;
+    for (uint32_t number : track_records[i].vertices)
+      track_vertices.push_back(vertices[number]);
+    const std::vector<int64_t> &ends = track_records[i].blocked_spans;
+    std::vector<std::pair<int64_t, int64_t>> blocked_spans;
+    for (size_t j = 0; j < ends.size(); j += 2)
+      blocked_spans.emplace_back(ends[j], ends[j + 1]);
+    tracks[i]->Restore(track_vertices, track_edges[i], blocked_spans);
+  }
+
+  std::map<Layer, size_t> num_available_by_layer;
+  for (uint32_t number : grid_vertices) {
+    for (const Layer &layer : vertex_records[number].layers)
+      ++num_available_by_layer[layer];
+  }
+  for (const auto &entry : num_available_by_layer)
+    GetAvailableVertices(entry.first).Reserve(entry.second);
+  vertices_.reserve(grid_vertices.size());
+  for (uint32_t number : grid_vertices) {
+    RoutingVertex *vertex = vertices[number];
+    for (const Layer &layer : vertex->connected_layers())
+      GetAvailableVertices(layer).Add(vertex);
+    vertex->set_grid_position(vertices_.size());
+    vertices_.push_back(vertex);
+  }
+
+  for (const PathRecord &record : path_records) {
+    std::deque<RoutingEdge*> path_edges;
+    for (uint32_t number : record.edges)
+      path_edges.push_back(edges[number]);
+    paths_.push_back(new RoutingPath(vertices[record.start], path_edges));
+  }
+
+  for (LazyRecord &record : lazy_records) {
+    LazyConnection connection;
+    connection.first = record.first;
+    connection.second = record.second;
+    connection.via_cost = record.via_cost;
+    connection.xs = std::move(record.xs);
+    for (uint32_t number : record.vertical_tracks)
+      connection.vertical_tracks.push_back(tracks[number]);
+    connection.ys = std::move(record.ys);
+    for (uint32_t number : record.horizontal_tracks)
+      connection.horizontal_tracks.push_back(tracks[number]);
+    connection.region_tracks = record.region_tracks;
+    connection.num_regions_x = record.num_regions_x;
+    connection.num_regions_y = record.num_regions_y;
+    connection.materialised.assign(record.materialised.begin(),
+                                   record.materialised.end());
+    for (uint8_t materialised : record.materialised) {
+      if (materialised)
+        ++connection.num_materialised;
+    }
+    lazy_connections_.push_back(std::move(connection));
+  }
+
+  graph_stale_ = true;
+  components_valid_ = false;
+  LOG(INFO) << "Read grid snapshot with " << vertices.size() << " vertices, "
+            << edges.size() << " edges and " << paths_.size()
+            << " paths from " << filename;
+  return true;
+}
+
+}  // namespace boralago
@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "routing_grid.h"
+
+// RoutingGrid::WriteStatsReport.
+//
+// The report is one JSON object:
+//
+//    {"build": {...}, "components": {...}, "totals": {...},
+//     "nets": {"<net>": {...}, ...}}
+//
+// where "totals" and each net are a RoutingPhaseStats, grouped by phase:
+//
+//    {"pattern_routes": n, "unreachable_rejections": n, "pin_access": {...},
+//     "search": {...}, "install": {...}}
+
+namespace boralago {
+
+namespace {
+
+std::string JsonString(const std::string &value) {
+  std::string quoted = "\"";
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        quoted += "\\\"";
+        break;
+      case '\\':
+        quoted += "\\\\";
+        break;
+      case '\n':
+        quoted += "\\n";
+        break;
+      case '\t':
+        quoted += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[7];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          quoted += escaped;
+        } else {
+          quoted += c;
+        }
+    }
+  }
+  return quoted + "\"";
+}
+
+void WritePhases(const RoutingPhaseStats &phases, std::ostream *out) {
+  *out << "{\"pattern_routes\": " << phases.pattern_routes
+       << ", \"unreachable_rejections\": " << phases.unreachable_rejections
+       << ", \"pin_access\": {"
+       << "\"calls\": " << phases.pin_accesses
+       << ", \"failures\": " << phases.pin_access_failures
+       << ", \"vertices_made\": " << phases.pin_access_vertices
+       << ", \"seconds\": " << phases.pin_access_seconds << "}"
+       << ", \"search\": {"
+       << "\"searches\": " << phases.searches
+       << ", \"vertices_expanded\": " << phases.vertices_expanded
+       << ", \"queue_pushes\": " << phases.queue_pushes
+       << ", \"stale_pops\": " << phases.stale_pops
+       << ", \"window_attempts\": " << phases.window_attempts
+       << ", \"windows_widened\": " << phases.windows_widened
+       << ", \"widest_window_margin\": " << phases.widest_window_margin
+       << ", \"seconds\": " << phases.search_seconds << "}"
+       << ", \"install\": {"
+       << "\"paths\": " << phases.paths_installed
+       << ", \"edges_used\": " << phases.edges_used
+       << ", \"edges_invalidated\": " << phases.edges_invalidated
+       << ", \"vertices_invalidated\": " << phases.vertices_invalidated
+       << ", \"blockage_merges\": " << phases.blockage_merges
+       << ", \"seconds\": " << phases.install_seconds << "}}";
+}
+
+}   // namespace
+
+bool RoutingGrid::WriteStatsReport(const std::string &filename) const {
+  std::ofstream out(filename, std::ios::out | std::ios::trunc);
+  if (!out) {
+    LOG(ERROR) << "Could not open " << filename << " to write routing stats";
+    return false;
+  }
+
+  out << "{\"build\": {"
+      << "\"vertices\": " << stats_.vertices_built
+      << ", \"lazy_regions\": " << stats_.regions_built
+      << ", \"seconds\": " << stats_.build_seconds << "},\n"
+      << " \"components\": {"
+      << "\"labellings\": " << stats_.component_labellings
+      << ", \"splits\": " << stats_.component_splits << "},\n"
+      << " \"totals\": ";
+  WritePhases(stats_.totals, &out);
+  out << ",\n \"nets\": {";
+  bool first = true;
+  for (const auto &entry : stats_.nets) {
+    out << (first ? "\n  " : ",\n  ") << JsonString(entry.first) << ": ";
+    WritePhases(entry.second, &out);
+    first = false;
+  }
+  out << "}}\n";
+
+  out.close();
+  if (!out) {
+    LOG(ERROR) << "Could not write routing stats to " << filename;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace boralago
@@ -0,0 +1,136 @@
+#ifndef ROUTING_OBJECT_POOL_H_
+#define ROUTING_OBJECT_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace boralago {
+
+// Names an object in a RoutingObjectPool: the slot it is in, and which of the
+// objects ever kept in that slot it is.
+struct RoutingHandle {
+  uint32_t index;
+  uint32_t generation;
+};
+
+// Storage for the many small objects (vertices and edges) making up a
+// RoutingGrid. Objects are made in blocks of slots, so building a grid takes a
+// few large allocations instead of one per object, and freeing the pool frees
+// the blocks in one go. Objects never move, so pointers to them stay good
+// until they are deleted.
+//
+// The slots of deleted objects are reused. Each slot counts the objects it
+// has held, so a RoutingHandle to a deleted object can be told apart from one
+// to whatever took its place.
+//
+// All objects still in the pool are destroyed with it.
+template <typename T>
+class RoutingObjectPool {
+ public:
+  static constexpr uint32_t kSlotsPerBlock = 4096;
+
+  RoutingObjectPool() : num_slots_(0), size_(0) {}
+
+  ~RoutingObjectPool() {
+    for (uint32_t i = 0; i < num_slots_; ++i) {
+      Slot &slot = SlotAt(i);
+      if (slot.live)
+        Object(&slot)->~T();
+    }
+  }
+
+  RoutingObjectPool(const RoutingObjectPool &other) = delete;
+  RoutingObjectPool &operator=(const RoutingObjectPool &other) = delete;
+
+  template <typename... Args>
+  T *New(Args&&... args) {
+    uint32_t index;
+    if (!free_.empty()) {
+      index = free_.back();
+      free_.pop_back();
+    } else {
+      if (num_slots_ % kSlotsPerBlock == 0)
+        blocks_.emplace_back(new Slot[kSlotsPerBlock]);
+      index = num_slots_++;
+      SlotAt(index).index = index;
+      SlotAt(index).generation = 0;
+    }
+    Slot &slot = SlotAt(index);
+    T *object = new (slot.storage) T(std::forward<Args>(args)...);
+    slot.live = true;
+    ++size_;
+    return object;
+  }
+
+  void Delete(T *object) {
+    Slot *slot = SlotOf(object);
+    LOG_IF(FATAL, !slot->live) << "Object deleted twice";
+    object->~T();
+    slot->live = false;
+    ++slot->generation;
+    free_.push_back(slot->index);
+    --size_;
+  }
+
+  // The object must be in the pool.
+  RoutingHandle HandleOf(const T *object) const {
+    const Slot *slot = SlotOf(object);
+    return {slot->index, slot->generation};
+  }
+
+  // Returns nullptr if the object has since been deleted.
+  T *Get(const RoutingHandle &handle) {
+    if (handle.index >= num_slots_)
+      return nullptr;
+    Slot &slot = SlotAt(handle.index);
+    if (!slot.live || slot.generation != handle.generation)
+      return nullptr;
+    return Object(&slot);
+  }
+
+  size_t size() const { return size_; }
+
+  // One more than the highest slot index ever used, so that objects can be
+  // numbered by the index in their handle.
+  uint32_t num_slots() const { return num_slots_; }
+
+ private:
+  struct Slot {
+    // This must come first, so that a pointer to the object is a pointer to
+    // its slot.
+    alignas(T) unsigned char storage[sizeof(T)];
+    uint32_t index;
+    uint32_t generation;
+    bool live = false;
+  };
+
+  Slot &SlotAt(uint32_t index) {
+    return blocks_[index / kSlotsPerBlock][index % kSlotsPerBlock];
+  }
+
+  static T *Object(Slot *slot) {
+    return std::launder(reinterpret_cast<T*>(slot->storage));
+  }
+  static Slot *SlotOf(T *object) {
+    return reinterpret_cast<Slot*>(object);
+  }
+  static const Slot *SlotOf(const T *object) {
+    return reinterpret_cast<const Slot*>(object);
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> blocks_;
+  // Slots whose objects have been deleted, to be used again.
+  std::vector<uint32_t> free_;
+  uint32_t num_slots_;
+  size_t size_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_OBJECT_POOL_H_
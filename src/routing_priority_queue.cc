@@ -0,0 +1,191 @@
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_priority_queue.h"
+
+namespace boralago {
+
+std::unique_ptr<RoutingPriorityQueue> MakeRoutingPriorityQueue(
+    const RoutingQueueType &type) {
+  switch (type) {
+    case RoutingQueueType::kQueueBinaryHeap:
+      return std::unique_ptr<RoutingPriorityQueue>(new BinaryHeapQueue());
+    case RoutingQueueType::kQueueRadixHeap:
+      return std::unique_ptr<RoutingPriorityQueue>(new RadixHeapQueue());
+    default:
+      LOG(FATAL) << "Unrecognised RoutingQueueType: " << type;
+  }
+  return nullptr;
+}
+
+void BinaryHeapQueue::Reset(size_t num_indices) {
+  // Popped indices have already been cleared.
+  for (const Entry &entry : heap_)
+    positions_[entry.index] = kNotQueued;
+  heap_.clear();
+  if (positions_.size() < num_indices)
+    positions_.resize(num_indices, kNotQueued);
+}
+
+void BinaryHeapQueue::Push(size_t index, double cost, double tie_breaker) {
+  Entry entry = {cost, tie_breaker, index};
+  size_t position = positions_[index];
+  if (position == kNotQueued) {
+    heap_.push_back(entry);
+    positions_[index] = heap_.size() - 1;
+    SiftUp(heap_.size() - 1);
+    return;
+  }
+  // Decrease-key. Nothing to do if the entry did not actually improve.
+  if (!Before(entry, heap_[position]))
+    return;
+  heap_[position] = entry;
+  SiftUp(position);
+}
+
+size_t BinaryHeapQueue::Pop() {
+  LOG_IF(FATAL, heap_.empty()) << "Cannot pop from an empty queue.";
+  size_t index = heap_.front().index;
+  positions_[index] = kNotQueued;
+
+  Entry last = heap_.back();
+  heap_.pop_back();
+  if (!heap_.empty()) {
+    Place(0, last);
+    SiftDown(0);
+  }
+  return index;
+}
+
+void BinaryHeapQueue::Place(size_t position, const Entry &entry) {
+  heap_[position] = entry;
+  positions_[entry.index] = position;
+}
+
+void BinaryHeapQueue::SiftUp(size_t position) {
+  Entry entry = heap_[position];
+  while (position > 0) {
+    size_t parent = (position - 1) / 2;
+    if (!Before(entry, heap_[parent]))
+      break;
+    Place(position, heap_[parent]);
+    position = parent;
+  }
+  Place(position, entry);
+}
+
+void BinaryHeapQueue::SiftDown(size_t position) {
+  Entry entry = heap_[position];
+  size_t size = heap_.size();
+  while (true) {
+    size_t child = 2 * position + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size && Before(heap_[child + 1], heap_[child]))
+      ++child;
+    if (!Before(heap_[child], entry))
+      break;
+    Place(position, heap_[child]);
+    position = child;
+  }
+  Place(position, entry);
+}
+
+void RadixHeapQueue::Reset(size_t num_indices) {
+  // Popped indices have already been cleared. keys_ is only read for queued
+  // indices so it does not need clearing.
+  for (auto &bucket : buckets_) {
+    for (const auto &entry : bucket)
+      queued_[entry.second] = false;
+    bucket.clear();
+  }
+  if (queued_.size() < num_indices) {
+    keys_.resize(num_indices, 0);
+    queued_.resize(num_indices, false);
+  }
+  size_ = 0;
+  last_popped_ = 0;
+  stale_pops_ = 0;
+}
+
+size_t RadixHeapQueue::BucketFor(uint64_t key) const {
+  if (key == last_popped_)
+    return 0;
+  // One more than the index of the highest bit that differs.
+  return 64 - __builtin_clzll(key ^ last_popped_);
+}
+
+void RadixHeapQueue::Push(
+    size_t index, double cost, double /* tie_breaker */) {
+  uint64_t key = static_cast<uint64_t>(std::llround(cost));
+  LOG_IF(FATAL, key < last_popped_)
+      << "RadixHeapQueue keys must be monotone; got " << key
+      << " after popping " << last_popped_;
+  if (queued_[index]) {
+    if (key >= keys_[index])
+      return;
+    // The existing entry is now stale and will be skipped.
+  } else {
+    queued_[index] = true;
+    ++size_;
+  }
+  keys_[index] = key;
+  buckets_[BucketFor(key)].emplace_back(key, index);
+}
+
+size_t RadixHeapQueue::Pop() {
+  LOG_IF(FATAL, size_ == 0) << "Cannot pop from an empty queue.";
+  auto is_live = [&](const std::pair<uint64_t, size_t> &entry) {
+    return queued_[entry.second] && keys_[entry.second] == entry.first;
+  };
+
+  while (true) {
+    std::vector<std::pair<uint64_t, size_t>> &bottom = buckets_[0];
+    while (!bottom.empty()) {
+      std::pair<uint64_t, size_t> entry = bottom.back();
+      bottom.pop_back();
+      if (!is_live(entry)) {
+        ++stale_pops_;
+        continue;
+      }
+      queued_[entry.second] = false;
+      --size_;
+      return entry.second;
+    }
+
+    // Find the first non-empty bucket and redistribute it around its minimum
+    // live key. Every entry lands in a strictly lower bucket.
+    size_t i = 1;
+    while (i < kNumBuckets && buckets_[i].empty())
+      ++i;
+    LOG_IF(FATAL, i == kNumBuckets)
+        << "RadixHeapQueue is out of entries but size is " << size_;
+
+    std::vector<std::pair<uint64_t, size_t>> entries;
+    entries.swap(buckets_[i]);
+    bool found_live = false;
+    for (const auto &entry : entries) {
+      if (!is_live(entry)) {
+        ++stale_pops_;
+        continue;
+      }
+      if (!found_live || entry.first < last_popped_) {
+        last_popped_ = entry.first;
+        found_live = true;
+      }
+    }
+    if (!found_live)
+      continue;
+    for (const auto &entry : entries) {
+      if (is_live(entry))
+        buckets_[BucketFor(entry.first)].push_back(entry);
+    }
+  }
+}
+
+}  // namespace boralago
@@ -0,0 +1,135 @@
+#ifndef ROUTING_PRIORITY_QUEUE_H_
+#define ROUTING_PRIORITY_QUEUE_H_
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace boralago {
+
+enum RoutingQueueType {
+  // Indexed binary heap with decrease-key. Works for any non-negative cost.
+  kQueueBinaryHeap,
+  // Monotone radix heap. Costs are rounded to the nearest integer, so this is
+  // only exact when all edge and vertex costs are integral.
+  kQueueRadixHeap
+};
+
+// The frontier for the shortest-path search. Entries are identified by the
+// contextual index of the vertex they refer to, which must be less than the
+// size given to Reset().
+//
+// Each index is in the queue at most once; pushing an index that is already
+// queued updates its cost (the search only ever decreases it).
+//
+// Entries of equal cost may be ordered by a secondary tie_breaker, lowest
+// first. This matters for A*, where many states can share the same estimated
+// total cost and we want to pop those nearest the goal first. Queues are free
+// to ignore it.
+class RoutingPriorityQueue {
+ public:
+  virtual ~RoutingPriorityQueue() = default;
+
+  // Empties the queue and prepares it to hold indices in [0, num_indices).
+  // Queues are reused between searches, so this should cost time proportional
+  // to what was left in the queue, not to num_indices.
+  virtual void Reset(size_t num_indices) = 0;
+
+  // Insert the index with the given cost, or decrease its cost if it is
+  // already queued.
+  virtual void Push(size_t index, double cost, double tie_breaker) = 0;
+  void Push(size_t index, double cost) { Push(index, cost, 0); }
+
+  // Remove and return the index with the lowest cost. The queue must not be
+  // empty.
+  virtual size_t Pop() = 0;
+
+  virtual bool Empty() const = 0;
+
+  // The number of stale entries (left behind when a queued index got a lower
+  // cost) found and thrown away by Pop since the last Reset. Queues that
+  // decrease costs in place never have any.
+  virtual size_t stale_pops() const { return 0; }
+};
+
+std::unique_ptr<RoutingPriorityQueue> MakeRoutingPriorityQueue(
+    const RoutingQueueType &type);
+
+// Orders entries by cost and then by tie_breaker.
+class BinaryHeapQueue : public RoutingPriorityQueue {
+ public:
+  using RoutingPriorityQueue::Push;
+
+  void Reset(size_t num_indices) override;
+  void Push(size_t index, double cost, double tie_breaker) override;
+  size_t Pop() override;
+  bool Empty() const override { return heap_.empty(); }
+
+ private:
+  static constexpr size_t kNotQueued = static_cast<size_t>(-1);
+
+  struct Entry {
+    double cost;
+    double tie_breaker;
+    size_t index;
+  };
+
+  static bool Before(const Entry &lhs, const Entry &rhs) {
+    return lhs.cost != rhs.cost ?
+        lhs.cost < rhs.cost : lhs.tie_breaker < rhs.tie_breaker;
+  }
+
+  void SiftUp(size_t position);
+  void SiftDown(size_t position);
+  void Place(size_t position, const Entry &entry);
+
+  // Entries in heap order.
+  std::vector<Entry> heap_;
+
+  // The position of each index in heap_, or kNotQueued.
+  std::vector<size_t> positions_;
+};
+
+// A radix heap keys entries by the highest bit in which they differ from the
+// last key popped. Because Dijkstra never pushes a key lower than the last one
+// popped, each entry moves down through at most 64 buckets over its lifetime,
+// so operations are amortised O(log C) in the largest cost C instead of
+// O(log n) in the size of the frontier.
+//
+// The tie_breaker is ignored: entries with the same (rounded) cost are
+// popped in an order fixed by when they were pushed, the most recent first.
+class RadixHeapQueue : public RoutingPriorityQueue {
+ public:
+  using RoutingPriorityQueue::Push;
+
+  RadixHeapQueue() : size_(0), last_popped_(0), stale_pops_(0) {}
+
+  void Reset(size_t num_indices) override;
+  void Push(size_t index, double cost, double tie_breaker) override;
+  size_t Pop() override;
+  bool Empty() const override { return size_ == 0; }
+  size_t stale_pops() const override { return stale_pops_; }
+
+ private:
+  static constexpr size_t kNumBuckets = 65;
+
+  size_t BucketFor(uint64_t key) const;
+
+  // (key, index) pairs. Decreasing a key pushes a new entry and leaves the
+  // old one to be discarded when it is found to be stale.
+  std::vector<std::pair<uint64_t, size_t>> buckets_[kNumBuckets];
+
+  // The current key for each queued index.
+  std::vector<uint64_t> keys_;
+  std::vector<bool> queued_;
+
+  // The number of live (not stale) entries.
+  size_t size_;
+  uint64_t last_popped_;
+  size_t stale_pops_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_PRIORITY_QUEUE_H_
@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "routing_priority_queue.h"
+#include "routing_search_workspace.h"
+
+namespace boralago {
+
+void RoutingSearchWorkspace::Begin(
+    size_t num_states, const RoutingQueueType &queue_type) {
+  if (stamps_.size() < num_states) {
+    // New entries get the stamp 0, which no search uses.
+    stamps_.resize(num_states, 0);
+    costs_.resize(num_states);
+    prev_states_.resize(num_states);
+    prev_slots_.resize(num_states);
+  }
+
+  if (epoch_ == std::numeric_limits<uint32_t>::max()) {
+    // Once every 4 billion searches we have to pay to clear the stamps.
+    std::fill(stamps_.begin(), stamps_.end(), 0);
+    epoch_ = 0;
+  }
+  ++epoch_;
+
+  if (!queue_ || queue_type != queue_type_) {
+    queue_ = MakeRoutingPriorityQueue(queue_type);
+    queue_type_ = queue_type;
+  }
+  queue_->Reset(num_states);
+}
+
+}  // namespace boralago
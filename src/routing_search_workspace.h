@@ -0,0 +1,70 @@
+#ifndef ROUTING_SEARCH_WORKSPACE_H_
+#define ROUTING_SEARCH_WORKSPACE_H_
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "routing_priority_queue.h"
+
+namespace boralago {
+
+// The scratch state of a shortest-path search (cost so far and the way back
+// for every state, plus the frontier), kept between searches so that starting
+// one does not cost time proportional to the whole grid.
+//
+// Each entry is stamped with the epoch of the search that last wrote it.
+// Entries with an older stamp read as unvisited, so starting a new search is
+// just incrementing the epoch. The arrays only ever grow.
+class RoutingSearchWorkspace {
+ public:
+  static constexpr size_t kNone = std::numeric_limits<size_t>::max();
+
+  RoutingSearchWorkspace()
+      : epoch_(0),
+        queue_type_(RoutingQueueType::kQueueBinaryHeap) {}
+
+  // Forgets the previous search and prepares for one over states in
+  // [0, num_states) using the given type of queue.
+  void Begin(size_t num_states, const RoutingQueueType &queue_type);
+
+  bool Visited(size_t state) const { return stamps_[state] == epoch_; }
+
+  // The best known cost to reach the state in this search, or the maximum
+  // double if it has not been reached.
+  double cost(size_t state) const {
+    return Visited(state) ? costs_[state] : std::numeric_limits<double>::max();
+  }
+  size_t prev_state(size_t state) const {
+    return Visited(state) ? prev_states_[state] : kNone;
+  }
+  size_t prev_slot(size_t state) const {
+    return Visited(state) ? prev_slots_[state] : kNone;
+  }
+
+  // Records that the state can be reached with the given cost by taking the
+  // edge in prev_slot from prev_state. The beginning has neither.
+  void Set(size_t state, double cost, size_t prev_state, size_t prev_slot) {
+    stamps_[state] = epoch_;
+    costs_[state] = cost;
+    prev_states_[state] = prev_state;
+    prev_slots_[state] = prev_slot;
+  }
+
+  RoutingPriorityQueue *queue() { return queue_.get(); }
+
+ private:
+  uint32_t epoch_;
+  std::vector<uint32_t> stamps_;
+  std::vector<double> costs_;
+  std::vector<size_t> prev_states_;
+  std::vector<size_t> prev_slots_;
+
+  RoutingQueueType queue_type_;
+  std::unique_ptr<RoutingPriorityQueue> queue_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_SEARCH_WORKSPACE_H_
@@ -0,0 +1,372 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "physical_properties_database.h"
+#include "point.h"
+#include "port.h"
+#include "rectangle.h"
+#include "routing_grid.h"
+#include "routing_priority_queue.h"
+
+// Checks of the router's behaviour, run by ctest. Each check returns whether
+// it passed, and logs what went wrong if not.
+
+namespace {
+
+static const int64_t kPitch = 100;
+static const int64_t kOffset = 50;
+
+bool Expect(bool condition, const std::string &what) {
+  if (!condition)
+    LOG(ERROR) << "Expected " << what;
+  return condition;
+}
+
+// Every queue pops in order of cost, and a pushed index that is already
+// queued takes the lower cost.
+bool QueuesPopInCostOrder() {
+  bool ok = true;
+  for (const boralago::RoutingQueueType &type : {
+          boralago::RoutingQueueType::kQueueBinaryHeap,
+          boralago::RoutingQueueType::kQueueRadixHeap}) {
+    std::unique_ptr<boralago::RoutingPriorityQueue> queue =
+        boralago::MakeRoutingPriorityQueue(type);
+    queue->Reset(8);
+    queue->Push(0, 5);
+    queue->Push(1, 3);
+    queue->Push(2, 9);
+    queue->Push(3, 4);
+    // Decreases the cost of 2 below everything else.
+    queue->Push(2, 1);
+    // Does not raise the cost of 1.
+    queue->Push(1, 7);
+
+    std::vector<size_t> popped;
+    while (!queue->Empty())
+      popped.push_back(queue->Pop());
+    ok = Expect(popped == std::vector<size_t>({2, 1, 3, 0}),
+                "queue type " + std::to_string(type) +
+                " to pop 2, 1, 3, 0") && ok;
+
+    // Queues are reused, so Reset must leave nothing behind.
+    queue->Reset(8);
+    ok = Expect(queue->Empty(), "queue to be empty after Reset") && ok;
+    queue->Push(4, 2);
+    ok = Expect(queue->Pop() == 4 && queue->Empty(),
+                "only the index pushed since Reset") && ok;
+  }
+  return ok;
+}
+
+// The binary heap orders entries of equal cost by their tie breakers.
+bool BinaryHeapBreaksTies() {
+  std::unique_ptr<boralago::RoutingPriorityQueue> queue =
+      boralago::MakeRoutingPriorityQueue(
+          boralago::RoutingQueueType::kQueueBinaryHeap);
+  queue->Reset(4);
+  queue->Push(0, 10, 3);
+  queue->Push(1, 10, 1);
+  queue->Push(2, 10, 2);
+  queue->Push(3, 5, 9);
+  std::vector<size_t> popped;
+  while (!queue->Empty())
+    popped.push_back(queue->Pop());
+  return Expect(popped == std::vector<size_t>({3, 1, 2, 0}),
+                "ties to be broken by the lowest tie breaker");
+}
+
+// The radix heap throws away the entries left behind by decreased costs, and
+// counts them.
+bool RadixHeapCountsStalePops() {
+  std::unique_ptr<boralago::RoutingPriorityQueue> queue =
+      boralago::MakeRoutingPriorityQueue(
+          boralago::RoutingQueueType::kQueueRadixHeap);
+  queue->Reset(4);
+  queue->Push(0, 8);
+  queue->Push(1, 9);
+  queue->Push(0, 2);
+  bool ok = Expect(queue->Pop() == 0, "0 first, at its decreased cost");
+  ok = Expect(queue->Pop() == 1, "1 second") && ok;
+  ok = Expect(queue->Empty(), "the stale entry for 0 not to count") && ok;
+  return Expect(queue->stale_pops() == 1, "one stale pop") && ok;
+}
+
+// Two layers of tracks, vertical on 4 and horizontal on 5, each num_tracks
+// wide, as in boralago_bench.
+void SetUpPhysicalDatabase(
+    int64_t num_tracks, boralago::PhysicalPropertiesDatabase *physical_db) {
+  int64_t side = num_tracks * kPitch;
+  boralago::RoutingLayerInfo layer_1;
+  layer_1.layer = 4;
+  layer_1.area = boralago::Rectangle(boralago::Point(0, 0), side, side);
+  layer_1.wire_width = 50;
+  layer_1.offset = kOffset;
+  layer_1.pitch = kPitch;
+  layer_1.direction = boralago::RoutingTrackDirection::kTrackVertical;
+
+  boralago::RoutingLayerInfo layer_2 = layer_1;
+  layer_2.layer = 5;
+  layer_2.direction = boralago::RoutingTrackDirection::kTrackHorizontal;
+
+  boralago::ViaInfo layer_1_2;
+  layer_1_2.layer = 6;
+  layer_1_2.cost = 1.0;
+  layer_1_2.width = 30;
+  layer_1_2.height = 30;
+  layer_1_2.overhang = 10;
+
+  physical_db->AddLayer(layer_1);
+  physical_db->AddLayer(layer_2);
+  physical_db->AddViaInfo(layer_1.layer, layer_2.layer, layer_1_2);
+}
+
+// A net of one driver and 16 sinks on a small grid is connected as one tree,
+// every sink ending one of its paths.
+bool MultiPointRouteConnectsEverySink() {
+  static const int64_t kNumTracks = 20;
+  boralago::PhysicalPropertiesDatabase physical_db;
+  SetUpPhysicalDatabase(kNumTracks, &physical_db);
+  boralago::RoutingGrid grid(physical_db);
+  grid.ConnectLayers(4, 5);
+
+  std::mt19937 generator(1);
+  std::uniform_int_distribution<int64_t> position(0, kNumTracks * kPitch - 1);
+  std::vector<std::unique_ptr<boralago::Port>> ports;
+  std::vector<const boralago::Port*> net;
+  for (int i = 0; i < 17; ++i) {
+    ports.emplace_back(new boralago::Port(
+        boralago::Point(position(generator), position(generator)), 50, 50,
+        i == 0 ? 4 : 5, "fanout"));
+    net.push_back(ports.back().get());
+  }
+  bool ok = Expect(grid.AddMultiPointRoute(net),
+                   "AddMultiPointRoute to connect every port");
+
+  std::set<const boralago::Port*> ends;
+  size_t num_starts = 0;
+  for (boralago::RoutingPath *path : grid.paths()) {
+    if (path->start_port())
+      ++num_starts;
+    if (path->end_port())
+      ends.insert(path->end_port());
+  }
+  ok = Expect(num_starts == 1 && ends.count(net.front()) == 0,
+              "the driver to start exactly one path") && ok;
+  for (size_t i = 1; i < net.size(); ++i) {
+    ok = Expect(ends.count(net[i]) == 1,
+                "sink " + std::to_string(i) + " to end a path") && ok;
+  }
+  return ok;
+}
+
+// The grid's vertices and the edges on them, by position, so that two states
+// of a grid can be compared.
+std::multiset<std::vector<int64_t>> GridShape(
+    const boralago::RoutingGrid &grid) {
+  std::multiset<std::vector<int64_t>> shape;
+  for (boralago::RoutingVertex *vertex : grid.vertices()) {
+    shape.insert({vertex->centre().x(), vertex->centre().y()});
+    for (boralago::RoutingEdge *edge : vertex->edges()) {
+      std::vector<int64_t> ends = {
+          edge->first()->centre().x(), edge->first()->centre().y(),
+          edge->second()->centre().x(), edge->second()->centre().y()};
+      if (ends[2] < ends[0] || (ends[2] == ends[0] && ends[3] < ends[1])) {
+        std::swap(ends[0], ends[2]);
+        std::swap(ends[1], ends[3]);
+      }
+      shape.insert(ends);
+    }
+  }
+  return shape;
+}
+
+// Removing a path puts the grid back as it was before the path was routed:
+// its tracks are joined up again, its vertices are back, and the bridging
+// vertices made for its ports are gone.
+bool RemovePathRestoresTracks() {
+  boralago::PhysicalPropertiesDatabase physical_db;
+  SetUpPhysicalDatabase(10, &physical_db);
+  boralago::RoutingGrid grid(physical_db);
+  grid.ConnectLayers(4, 5);
+  std::multiset<std::vector<int64_t>> before = GridShape(grid);
+
+  // Off the grid, so that both ends need bridging vertices.
+  boralago::Port begin(boralago::Point(170, 130), 50, 50, 4, "a");
+  boralago::Port end(boralago::Point(720, 580), 50, 50, 5, "a");
+  boralago::RoutingSearchStats first_stats;
+  bool ok = Expect(grid.AddRouteBetween(
+                       begin, end, boralago::RoutingSearchOptions(),
+                       &first_stats) && grid.paths().size() == 1,
+                   "the route to be made");
+  if (!ok)
+    return false;
+  ok = Expect(grid.RemovePath(grid.paths().front()) && grid.paths().empty(),
+              "the path to be removed") && ok;
+  ok = Expect(GridShape(grid) == before,
+              "the same vertices and edges as before the route") && ok;
+
+  boralago::RoutingSearchStats second_stats;
+  ok = Expect(grid.AddRouteBetween(
+                  begin, end, boralago::RoutingSearchOptions(),
+                  &second_stats) &&
+              second_stats.path_cost == first_stats.path_cost,
+              "the route to be made again at the same cost") && ok;
+  return ok;
+}
+
+// A file in the temporary directory for this check to write.
+std::string TemporaryFile(const std::string &name) {
+  const char *directory = getenv("TMPDIR");
+  return std::string(directory ? directory : "/tmp") + "/" + name;
+}
+
+bool ReadFile(const std::string &filename, std::string *contents) {
+  std::ifstream file(filename, std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  *contents = buffer.str();
+  return file.good();
+}
+
+bool WriteFile(const std::string &filename, const std::string &contents) {
+  std::ofstream file(filename, std::ios::binary);
+  file << contents;
+  return file.good();
+}
+
+// A 10-track grid with one route on it, away from its top right corner.
+void SetUpRoutedGrid(boralago::RoutingGrid *grid) {
+  grid->ConnectLayers(4, 5);
+  boralago::Port begin(boralago::Point(150, 150), 50, 50, 4, "a");
+  boralago::Port end(boralago::Point(550, 350), 50, 50, 5, "a");
+  grid->AddRouteBetween(begin, end);
+}
+
+// A grid read back from its snapshot has what was written, and routes the
+// same as the original.
+bool SnapshotRoundTrips() {
+  boralago::PhysicalPropertiesDatabase physical_db;
+  SetUpPhysicalDatabase(10, &physical_db);
+  boralago::RoutingGrid grid(physical_db);
+  SetUpRoutedGrid(&grid);
+  std::string filename = TemporaryFile("routing_tests_round_trip.bin");
+  bool ok = Expect(grid.WriteSnapshot(filename), "the snapshot to be written");
+
+  boralago::RoutingGrid copy(physical_db);
+  ok = Expect(copy.ReadSnapshot(filename), "the snapshot to be read") && ok;
+  ok = Expect(copy.vertices().size() == grid.vertices().size(),
+              "the same number of vertices") && ok;
+  ok = Expect(copy.paths().size() == grid.paths().size(),
+              "the same number of paths") && ok;
+
+  boralago::Port begin(boralago::Point(750, 150), 50, 50, 4, "b");
+  boralago::Port end(boralago::Point(350, 850), 50, 50, 5, "b");
+  boralago::RoutingSearchStats grid_stats;
+  boralago::RoutingSearchStats copy_stats;
+  bool routed = grid.AddRouteBetween(
+      begin, end, boralago::RoutingSearchOptions(), &grid_stats);
+  ok = Expect(routed && copy.AddRouteBetween(
+                  begin, end, boralago::RoutingSearchOptions(), &copy_stats),
+              "both grids to route another net") && ok;
+  ok = Expect(grid_stats.path_cost == copy_stats.path_cost,
+              "the same cost on both grids") && ok;
+  remove(filename.c_str());
+  return ok;
+}
+
+// A snapshot that is cut short, or has a vertex out of place on its tracks,
+// is refused and leaves the grid alone.
+bool SnapshotRejectsMalformedTracks() {
+  boralago::PhysicalPropertiesDatabase physical_db;
+  SetUpPhysicalDatabase(10, &physical_db);
+  boralago::RoutingGrid grid(physical_db);
+  SetUpRoutedGrid(&grid);
+  std::string filename = TemporaryFile("routing_tests_malformed.bin");
+  std::string snapshot;
+  bool ok = Expect(grid.WriteSnapshot(filename) &&
+                   ReadFile(filename, &snapshot),
+                   "the snapshot to be written");
+
+  // The vertex in the top right corner, at (950, 950), is the only place
+  // those two numbers follow one another.
+  const int64_t corner[2] = {950, 950};
+  std::string pattern(reinterpret_cast<const char*>(corner), sizeof(corner));
+  size_t position = snapshot.find(pattern);
+  ok = Expect(position != std::string::npos &&
+              snapshot.find(pattern, position + 1) == std::string::npos,
+              "the corner vertex to be found once") && ok;
+  if (!ok)
+    return false;
+
+  struct Corruption {
+    std::string what;
+    std::string contents;
+  };
+  std::vector<Corruption> corruptions;
+  corruptions.push_back(
+      {"a truncated snapshot", snapshot.substr(0, snapshot.size() / 2)});
+  // Along its horizontal track onto its neighbour, and off it.
+  const int64_t moves[2][2] = {{850, 950}, {950, 960}};
+  for (const auto &moved : moves) {
+    std::string contents = snapshot;
+    std::memcpy(&contents[position], moved, sizeof(moved));
+    corruptions.push_back(
+        {"a vertex moved to (" + std::to_string(moved[0]) + ", " +
+         std::to_string(moved[1]) + ")", contents});
+  }
+
+  for (const Corruption &corruption : corruptions) {
+    boralago::RoutingGrid copy(physical_db);
+    ok = Expect(WriteFile(filename, corruption.contents) &&
+                !copy.ReadSnapshot(filename) && copy.vertices().empty(),
+                corruption.what + " to be refused") && ok;
+  }
+  remove(filename.c_str());
+  return ok;
+}
+
+}   // namespace
+
+int main(int argc, char **argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  struct Check {
+    std::string name;
+    bool (*run)();
+  };
+  std::vector<Check> checks = {
+      {"QueuesPopInCostOrder", QueuesPopInCostOrder},
+      {"BinaryHeapBreaksTies", BinaryHeapBreaksTies},
+      {"RadixHeapCountsStalePops", RadixHeapCountsStalePops},
+      {"MultiPointRouteConnectsEverySink", MultiPointRouteConnectsEverySink},
+      {"RemovePathRestoresTracks", RemovePathRestoresTracks},
+      {"SnapshotRoundTrips", SnapshotRoundTrips},
+      {"SnapshotRejectsMalformedTracks", SnapshotRejectsMalformedTracks},
+  };
+
+  size_t num_failed = 0;
+  for (const Check &check : checks) {
+    bool passed = check.run();
+    if (!passed)
+      ++num_failed;
+    std::cout << (passed ? "PASS " : "FAIL ") << check.name << std::endl;
+  }
+  std::cout << checks.size() - num_failed << " of " << checks.size()
+            << " checks passed" << std::endl;
+  return num_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
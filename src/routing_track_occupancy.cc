@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_track_occupancy.h"
+
+namespace boralago {
+
+namespace {
+
+static const int64_t kBitsPerWord = 64;
+
+// Rounds towards negative infinity, unlike /. The divisor must be positive.
+int64_t FloorDiv(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// The bits of the given word that lie in [first, last].
+uint64_t MaskFor(int64_t word, int64_t first, int64_t last) {
+  int64_t low = std::max(first - word * kBitsPerWord, int64_t(0));
+  int64_t high = std::min(last - word * kBitsPerWord, kBitsPerWord - 1);
+  return (~uint64_t(0) >> (kBitsPerWord - 1 - high)) &
+      (~uint64_t(0) << low);
+}
+
+}   // namespace
+
+void RoutingTrackOccupancy::SetPitch(int64_t start, int64_t pitch) {
+  LOG_IF(FATAL, pitch < 0) << "RoutingTrackOccupancy pitch must not be "
+                           << "negative: " << pitch;
+  start_ = start;
+  pitch_ = pitch;
+  first_word_ = 0;
+  occupied_.clear();
+  covered_.clear();
+}
+
+int64_t RoutingTrackOccupancy::BitAt(
+    int64_t position, bool *in_interval) const {
+  int64_t point = FloorDiv(position - start_, pitch_);
+  *in_interval = position - start_ != point * pitch_;
+  return 2 * point + (*in_interval ? 1 : 0);
+}
+
+void RoutingTrackOccupancy::Occupy(int64_t low, int64_t high) {
+  if (pitch_ == 0)
+    return;
+  bool low_in_interval;
+  bool high_in_interval;
+  int64_t first = BitAt(low, &low_in_interval);
+  int64_t last = BitAt(high, &high_in_interval);
+  Cover(first, last);
+  SetBits(first, last, first_word_, true, &occupied_);
+  // The intervals the ends fall inside are only partly blocked.
+  int64_t first_covered = low_in_interval ? first + 1 : first;
+  int64_t last_covered = high_in_interval ? last - 1 : last;
+  if (first_covered <= last_covered)
+    SetBits(first_covered, last_covered, first_word_, true, &covered_);
+}
+
+void RoutingTrackOccupancy::Clear(int64_t low, int64_t high) {
+  if (pitch_ == 0)
+    return;
+  bool in_interval;
+  int64_t first = BitAt(low, &in_interval);
+  int64_t last = BitAt(high, &in_interval);
+  SetBits(first, last, first_word_, false, &occupied_);
+  SetBits(first, last, first_word_, false, &covered_);
+}
+
+RoutingTrackOccupancy::Answer RoutingTrackOccupancy::Query(
+    int64_t low, int64_t high) const {
+  if (pitch_ == 0)
+    return kUnsure;
+  bool low_in_interval;
+  bool high_in_interval;
+  int64_t first = BitAt(low, &low_in_interval);
+  int64_t last = BitAt(high, &high_in_interval);
+
+  // Anything touching a point or interval wholly inside the span overlaps it.
+  int64_t first_inside = low_in_interval ? first + 1 : first;
+  int64_t last_inside = high_in_interval ? last - 1 : last;
+  if (first_inside <= last_inside &&
+      AnyBits(first_inside, last_inside, first_word_, occupied_))
+    return kOccupied;
+
+  // In the intervals the ends fall inside, only a blockage covering all of
+  // one is sure to overlap the span.
+  bool unsure = false;
+  for (int64_t end : {first, last}) {
+    if (end == first ? !low_in_interval : !high_in_interval)
+      continue;
+    if (AnyBits(end, end, first_word_, covered_))
+      return kOccupied;
+    if (AnyBits(end, end, first_word_, occupied_))
+      unsure = true;
+  }
+  return unsure ? kUnsure : kFree;
+}
+
+void RoutingTrackOccupancy::Cover(int64_t first, int64_t last) {
+  int64_t first_word = FloorDiv(first, kBitsPerWord);
+  int64_t last_word = FloorDiv(last, kBitsPerWord);
+  if (occupied_.empty()) {
+    first_word_ = first_word;
+  } else if (first_word < first_word_) {
+    size_t num_new = first_word_ - first_word;
+    occupied_.insert(occupied_.begin(), num_new, 0);
+    covered_.insert(covered_.begin(), num_new, 0);
+    first_word_ = first_word;
+  }
+  size_t num_words = last_word - first_word_ + 1;
+  if (num_words > occupied_.size()) {
+    occupied_.resize(num_words, 0);
+    covered_.resize(num_words, 0);
+  }
+}
+
+void RoutingTrackOccupancy::SetBits(
+    int64_t first, int64_t last, int64_t first_word, bool value,
+    std::vector<uint64_t> *words) {
+  int64_t end_word = first_word + static_cast<int64_t>(words->size());
+  int64_t from = std::max(FloorDiv(first, kBitsPerWord), first_word);
+  int64_t to = std::min(FloorDiv(last, kBitsPerWord), end_word - 1);
+  for (int64_t word = from; word <= to; ++word) {
+    uint64_t mask = MaskFor(word, first, last);
+    uint64_t &bits = (*words)[word - first_word];
+    bits = value ? bits | mask : bits & ~mask;
+  }
+}
+
+bool RoutingTrackOccupancy::AnyBits(
+    int64_t first, int64_t last, int64_t first_word,
+    const std::vector<uint64_t> &words) {
+  int64_t end_word = first_word + static_cast<int64_t>(words.size());
+  int64_t from = std::max(FloorDiv(first, kBitsPerWord), first_word);
+  int64_t to = std::min(FloorDiv(last, kBitsPerWord), end_word - 1);
+  for (int64_t word = from; word <= to; ++word) {
+    if (words[word - first_word] & MaskFor(word, first, last))
+      return true;
+  }
+  return false;
+}
+
+}  // namespace boralago
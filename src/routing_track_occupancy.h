@@ -0,0 +1,83 @@
+#ifndef ROUTING_TRACK_OCCUPANCY_H_
+#define ROUTING_TRACK_OCCUPANCY_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace boralago {
+
+// The parts of a RoutingTrack that are blocked, packed into bits so that
+// whether a span is free can be answered by scanning a few words instead of
+// searching the track's blockages.
+//
+// Positions along the track are cut at every pitch from a start (where the
+// track's vertices usually are) into points and the open intervals between
+// them. Each gets two bits, in order, so that point k is bit 2k and the
+// interval after it is bit 2k + 1:
+//
+//    point     0       1       2
+//              |-------|-------|--
+//    bit       0   1   2   3   4
+//
+// A bit is occupied if any blocked span touches that point or interval, and
+// covered if one blocked span contains all of it. Spans between points, which
+// is nearly all of them, are then answered exactly. Only where the ends of
+// both a span and a blockage fall inside the same interval do the bits not
+// tell, and the caller has to look at the blockages themselves.
+class RoutingTrackOccupancy {
+ public:
+  enum Answer {
+    kFree,
+    kOccupied,
+    kUnsure
+  };
+
+  RoutingTrackOccupancy() : start_(0), pitch_(0), first_word_(0) {}
+
+  // Forgets everything occupied and cuts positions at the given pitch from
+  // start. With no pitch (0) nothing is kept and every query is unsure.
+  void SetPitch(int64_t start, int64_t pitch);
+
+  // Marks the span [low, high] as blocked.
+  void Occupy(int64_t low, int64_t high);
+
+  // Forgets what was blocked in every point and interval that [low, high]
+  // touches, including parts of it outside the span. Whatever is still
+  // blocked there must be occupied again.
+  void Clear(int64_t low, int64_t high);
+
+  // Whether anything blocked overlaps [low, high].
+  Answer Query(int64_t low, int64_t high) const;
+
+  int64_t start() const { return start_; }
+  int64_t pitch() const { return pitch_; }
+
+ private:
+  // The bit for the point or interval at the position, and whether it is an
+  // interval.
+  int64_t BitAt(int64_t position, bool *in_interval) const;
+
+  // Makes sure the words holding bits first to last exist.
+  void Cover(int64_t first, int64_t last);
+
+  // Sets or clears bits first to last, inclusive, a word at a time.
+  static void SetBits(int64_t first, int64_t last, int64_t first_word,
+                      bool value, std::vector<uint64_t> *words);
+
+  // Whether any of bits first to last, inclusive, is set. Bits outside the
+  // words are not.
+  static bool AnyBits(int64_t first, int64_t last, int64_t first_word,
+                      const std::vector<uint64_t> &words);
+
+  int64_t start_;
+  int64_t pitch_;
+
+  // Both hold bits from 64 * first_word_ onward.
+  int64_t first_word_;
+  std::vector<uint64_t> occupied_;
+  std::vector<uint64_t> covered_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_TRACK_OCCUPANCY_H_
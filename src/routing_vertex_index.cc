@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "routing_grid.h"
+#include "routing_vertex_index.h"
+
+namespace boralago {
+
+int64_t RoutingVertexIndex::CellFor(int64_t coordinate) const {
+  // Round towards negative infinity, so that cells are all the same size
+  // either side of the origin.
+  int64_t cell = coordinate / cell_size_;
+  if (coordinate % cell_size_ < 0)
+    --cell;
+  return cell;
+}
+
+void RoutingVertexIndex::Add(RoutingVertex *vertex) {
+  int64_t cell_x = CellFor(vertex->centre().x());
+  int64_t cell_y = CellFor(vertex->centre().y());
+  if (buckets_.empty()) {
+    min_cell_x_ = max_cell_x_ = cell_x;
+    min_cell_y_ = max_cell_y_ = cell_y;
+  } else {
+    min_cell_x_ = std::min(min_cell_x_, cell_x);
+    max_cell_x_ = std::max(max_cell_x_, cell_x);
+    min_cell_y_ = std::min(min_cell_y_, cell_y);
+    max_cell_y_ = std::max(max_cell_y_, cell_y);
+  }
+  buckets_[Key(cell_x, cell_y)].push_back({vertex, next_sequence_++});
+  ++size_;
+}
+
+bool RoutingVertexIndex::Remove(RoutingVertex *vertex) {
+  auto it = buckets_.find(
+      Key(CellFor(vertex->centre().x()), CellFor(vertex->centre().y())));
+  if (it == buckets_.end())
+    return false;
+  std::vector<Entry> &bucket = it->second;
+  for (size_t i = 0; i < bucket.size(); ++i) {
+    if (bucket[i].vertex != vertex)
+      continue;
+    // The order within a bucket does not matter.
+    bucket[i] = bucket.back();
+    bucket.pop_back();
+    --size_;
+    return true;
+  }
+  return false;
+}
+
+void RoutingVertexIndex::FindNearest(
+    const Point &point,
+    size_t k,
+    std::vector<RoutingVertex*> *nearest) const {
+  nearest->clear();
+  if (k == 0 || size_ == 0)
+    return;
+
+  // (distance, x, y, sequence) orders candidates completely.
+  typedef std::tuple<uint64_t, int64_t, int64_t, uint64_t, RoutingVertex*>
+      Candidate;
+  std::vector<Candidate> candidates;
+
+  auto visit = [&](int64_t cell_x, int64_t cell_y) {
+    if (cell_x < min_cell_x_ || cell_x > max_cell_x_ ||
+        cell_y < min_cell_y_ || cell_y > max_cell_y_)
+      return;
+    auto it = buckets_.find(Key(cell_x, cell_y));
+    if (it == buckets_.end())
+      return;
+    for (const Entry &entry : it->second) {
+      const Point &centre = entry.vertex->centre();
+      candidates.emplace_back(entry.vertex->L1DistanceTo(point),
+                              centre.x(), centre.y(), entry.sequence,
+                              entry.vertex);
+    }
+  };
+
+  int64_t centre_x = CellFor(point.x());
+  int64_t centre_y = CellFor(point.y());
+  for (int64_t ring = 0; ; ++ring) {
+    if (ring == 0) {
+      visit(centre_x, centre_y);
+    } else {
+      // The rows above and below, then the columns either side, skipping
+      // the parts outside the occupied range.
+      int64_t low_x = std::max(centre_x - ring, min_cell_x_);
+      int64_t high_x = std::min(centre_x + ring, max_cell_x_);
+      for (int64_t y : {centre_y - ring, centre_y + ring}) {
+        if (y < min_cell_y_ || y > max_cell_y_)
+          continue;
+        for (int64_t x = low_x; x <= high_x; ++x)
+          visit(x, y);
+      }
+      int64_t low_y = std::max(centre_y - ring + 1, min_cell_y_);
+      int64_t high_y = std::min(centre_y + ring - 1, max_cell_y_);
+      for (int64_t x : {centre_x - ring, centre_x + ring}) {
+        if (x < min_cell_x_ || x > max_cell_x_)
+          continue;
+        for (int64_t y = low_y; y <= high_y; ++y)
+          visit(x, y);
+      }
+    }
+
+    bool covered_all = centre_x - ring <= min_cell_x_ &&
+        centre_x + ring >= max_cell_x_ &&
+        centre_y - ring <= min_cell_y_ &&
+        centre_y + ring >= max_cell_y_;
+    if (covered_all)
+      break;
+
+    // Anything in the next ring is at least ring * cell_size_ + 1 away.
+    if (candidates.size() >= k) {
+      std::nth_element(candidates.begin(), candidates.begin() + k - 1,
+                       candidates.end());
+      if (std::get<0>(candidates[k - 1]) <=
+          static_cast<uint64_t>(ring * cell_size_))
+        break;
+    }
+  }
+
+  size_t num_nearest = std::min(k, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + num_nearest,
+                    candidates.end());
+  for (size_t i = 0; i < num_nearest; ++i)
+    nearest->push_back(std::get<4>(candidates[i]));
+}
+
+}  // namespace boralago
@@ -0,0 +1,85 @@
+#ifndef ROUTING_VERTEX_INDEX_H_
+#define ROUTING_VERTEX_INDEX_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "point.h"
+
+namespace boralago {
+
+class RoutingVertex;
+
+// A spatial index of vertices for finding those nearest a point.
+//
+// Vertices are kept in buckets of a uniform grid of square cells, keyed by the
+// cell containing their centre. The cells should be about a track pitch
+// across, so that each holds a vertex or so; the nearest vertices are then
+// found by visiting cells in rings of increasing size around the point, and
+// only a handful are ever looked at. Cells that have never held a vertex take
+// no space.
+//
+// Vertices are NOT OWNED by the index.
+class RoutingVertexIndex {
+ public:
+  RoutingVertexIndex(int64_t cell_size)
+      : cell_size_(cell_size > 0 ? cell_size : 1),
+        size_(0),
+        next_sequence_(0),
+        min_cell_x_(0),
+        max_cell_x_(0),
+        min_cell_y_(0),
+        max_cell_y_(0) {}
+
+  void Add(RoutingVertex *vertex);
+
+  // Makes room for about this many vertices, when they are known to be
+  // coming.
+  void Reserve(size_t num_vertices) { buckets_.reserve(num_vertices); }
+
+  // Returns false if the vertex was not in the index.
+  bool Remove(RoutingVertex *vertex);
+
+  // Replaces the contents of nearest with the (up to) k vertices nearest to
+  // the point by L1 distance, nearest first. Ties are broken by position and
+  // then by the order in which vertices were added, so that the result does
+  // not depend on where they happen to be in memory.
+  void FindNearest(const Point &point,
+                   size_t k,
+                   std::vector<RoutingVertex*> *nearest) const;
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  struct Entry {
+    RoutingVertex *vertex;
+    // When the vertex was added, for breaking ties.
+    uint64_t sequence;
+  };
+
+  int64_t CellFor(int64_t coordinate) const;
+
+  static uint64_t Key(int64_t cell_x, int64_t cell_y) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cell_x)) << 32) |
+        static_cast<uint32_t>(cell_y);
+  }
+
+  int64_t cell_size_;
+  size_t size_;
+  uint64_t next_sequence_;
+
+  // The range of cells that have ever held a vertex. The search stops once it
+  // has covered them.
+  int64_t min_cell_x_;
+  int64_t max_cell_x_;
+  int64_t min_cell_y_;
+  int64_t max_cell_y_;
+
+  std::unordered_map<uint64_t, std::vector<Entry>> buckets_;
+};
+
+}  // namespace boralago
+
+#endif  // ROUTING_VERTEX_INDEX_H_